@@ -0,0 +1,5 @@
+@echo off
+cd bin
+verificator.exe --all ../../../RIS
+cd ..
+pause
\ No newline at end of file
@@ -0,0 +1,343 @@
+#include "asset_index.hpp"
+
+#include <algorithm>
+#include <bit>
+#include <cerrno>
+#include <condition_variable>
+#include <dcc/logger.hpp>
+#include <filesystem>
+#include <future>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+#ifndef _WIN32
+#include <sys/stat.h>
+#endif
+
+using namespace std;
+using namespace dcc;
+namespace fs = std::filesystem;
+
+string asset_index::normalize(string_view path) {
+  string n;
+  n.reserve(path.size());
+  for (char c : path) {
+    if (c == '\\')
+      c = '/';
+    else if (c >= 'A' and c <= 'Z')
+      c = c - 'A' + 'a';
+    if (c == '/' and (n.empty() or n.back() == '/'))
+      continue;
+    n += c;
+  }
+  while (n.starts_with("./"))
+    n.erase(0, 2);
+  if (n.ends_with('/'))
+    n.pop_back();
+  return n;
+}
+
+// `path` in the layer at `root`.
+static string join(string_view root, string_view path) {
+  if (root.empty() or fs::path(path).is_absolute())
+    return string(path);
+  return fmt::format("{}/{}", root, path);
+}
+
+static void log_error(const fs::path& dir, const error_code& ec) {
+  dcc_logerr("Could not read {}: {}.", sgr::file(dir.generic_string()),
+             ec.message());
+}
+
+// What tells a directory apart however it is reached.
+#ifdef _WIN32
+using dir_id = fs::path;
+
+static int identify(const fs::path& dir, dir_id& id) {
+  error_code ec;
+  id = fs::canonical(dir, ec);
+  return ec ? -1 : 0;
+}
+#else
+using dir_id = pair<dev_t, ino_t>;
+
+static int identify(const fs::path& dir, dir_id& id) {
+  struct stat st;
+  if (stat(dir.c_str(), &st) == -1)
+    return -1;
+  id = {st.st_dev, st.st_ino};
+  return 0;
+}
+#endif
+
+// Every path below `dir`, without its first `skip` characters. Directory
+// symlinks are followed, but not back into a directory the walk is in.
+static vector<string> walk(const fs::path& dir, size_t skip) {
+  vector<string> v;
+  vector<pair<fs::directory_iterator, dir_id>> open;
+  auto enter = [&open](const fs::path& d) {
+    dir_id id;
+    if (identify(d, id) == -1)
+      return;
+    for (const auto& o : open)
+      if (o.second == id)
+        return;
+    error_code ec;
+    fs::directory_iterator it(d, fs::directory_options::skip_permission_denied,
+                              ec);
+    if (ec)
+      log_error(d, ec);
+    else
+      open.emplace_back(move(it), move(id));
+  };
+  enter(dir);
+  while (not open.empty()) {
+    auto& it = open.back().first;
+    if (it == fs::directory_iterator()) {
+      open.pop_back();
+      continue;
+    }
+    fs::path p = it->path();
+    error_code ec;
+    bool is_dir = it->is_directory(ec);
+    if (it.increment(ec); ec)
+      log_error(p.parent_path(), ec);
+    v.push_back(p.generic_string().substr(skip));
+    if (is_dir)
+      enter(p);
+  }
+  return v;
+}
+
+int asset_index::add_layer(string_view root) {
+  if (roots.size() == 32) {
+    errno = E2BIG;
+    return -1;
+  }
+  string r = fs::path(root).generic_string();
+  while (r.size() > 1 and r.ends_with('/'))
+    r.pop_back();
+  roots.push_back(move(r));
+  return 0;
+}
+
+void asset_index::build(string_view dir) {
+  indexed_dir = normalize(dir);
+  paths.clear();
+
+  // Top-level directories of a mod differ greatly in size (models vs. ui vs.
+  // text), so each one gets its own walker. The layers are walked all at
+  // once, but merged in order.
+  vector<vector<string>> tops(roots.size());
+  vector<vector<future<vector<string>>>> walkers(roots.size());
+  for (size_t layer = 0; layer < roots.size(); ++layer) {
+    string top = join(roots[layer], dir);
+    size_t skip = roots[layer].empty() ? 0 : roots[layer].size() + 1;
+    error_code ec;
+    if (layer == 0 or fs::is_directory(top, ec))
+      tops[layer].push_back(string(dir));
+    auto it = fs::directory_iterator(top, ec);
+    if (ec) {
+      if (ec != errc::no_such_file_or_directory)
+        log_error(top, ec);
+      continue;
+    }
+    for (; it != fs::directory_iterator(); it.increment(ec)) {
+      tops[layer].push_back(it->path().generic_string().substr(skip));
+      if (it->is_directory(ec))
+        walkers[layer].push_back(
+          async(launch::async, walk, it->path(), skip));
+    }
+    if (ec)
+      log_error(top, ec);
+  }
+  for (size_t layer = 0; layer < roots.size(); ++layer) {
+    for (const auto& p : tops[layer])
+      add(layer, p);
+    for (auto& w : walkers[layer])
+      for (const auto& p : w.get())
+        add(layer, p);
+  }
+}
+
+void asset_index::add(string_view path) { add(0, path); }
+
+void asset_index::add(size_t layer, string_view path) {
+  string n = normalize(path);
+  string spelling = n == path ? "" : string(path);
+  uint32_t bit = uint32_t(1) << layer;
+  entry& e = paths.try_emplace(move(n), entry{0, ""}).first->second;
+  if ((e.layers & (bit - 1)) == 0)
+    e.spelling = move(spelling);
+  e.layers |= bit;
+}
+
+void asset_index::remove(string_view path, bool directory) {
+  string n = normalize(path);
+  auto it = paths.find(n);
+  if (it == paths.end() or not (it->second.layers & 1))
+    return;
+
+  // What the mod no longer has is left to the layers below, if they have it.
+  auto uncover = [this](auto it) {
+    entry& e = it->second;
+    e.layers &= ~uint32_t(1);
+    if (e.layers == 0)
+      return paths.erase(it);
+    e.spelling = spelling_in(countr_zero(e.layers), it->first);
+    return ++it;
+  };
+  uncover(it);
+
+  // Only a directory has anything below it, and finding that takes a scan.
+  if (not directory)
+    return;
+  string prefix = n + '/';
+  for (it = paths.begin(); it != paths.end();) {
+    if (it->first.starts_with(prefix) and (it->second.layers & 1))
+      it = uncover(it);
+    else
+      ++it;
+  }
+}
+
+bool asset_index::indexed(string_view n) const {
+  return not indexed_dir.empty() and n.starts_with(indexed_dir) and
+         (n.size() == indexed_dir.size() or n[indexed_dir.size()] == '/');
+}
+
+// How the normalized path `n` is spelt on disk in `layer`, if that differs.
+string asset_index::spelling_in(size_t layer, const string& n) const {
+  fs::path at = roots[layer].empty() ? fs::path(".") : fs::path(roots[layer]);
+  string spelt;
+  for (size_t begin = 0; begin <= n.size();) {
+    size_t end = min(n.find('/', begin), n.size());
+    string name = n.substr(begin, end - begin);
+    error_code ec;
+    if (not fs::exists(at / name, ec)) {
+      for (auto it = fs::directory_iterator(at, ec);
+           it != fs::directory_iterator(); it.increment(ec)) {
+        if (ec)
+          break;
+        string candidate = it->path().filename().generic_string();
+        if (normalize(candidate) == name) {
+          name = move(candidate);
+          break;
+        }
+      }
+    }
+    at /= name;
+    spelt += spelt.empty() ? name : "/" + name;
+    begin = end + 1;
+  }
+  return spelt == n ? "" : spelt;
+}
+
+bool asset_index::exists(string_view path) const { return layer(path) != -1; }
+
+int asset_index::layer(string_view path) const {
+  string n = normalize(path);
+  if (indexed(n)) {
+    auto it = paths.find(n);
+    return it == paths.end() ? -1 : countr_zero(it->second.layers);
+  }
+  for (size_t i = 0; i < roots.size(); ++i)
+    if (fs::exists(join(roots[i], path)))
+      return int(i);
+  return -1;
+}
+
+string asset_index::resolve(string_view path) const {
+  string n = normalize(path);
+  if (not indexed(n)) {
+    for (const auto& root : roots)
+      if (string p = join(root, path); fs::exists(p))
+        return p;
+    return "";
+  }
+  auto it = paths.find(n);
+  if (it == paths.end())
+    return "";
+  const entry& e = it->second;
+  return join(roots[countr_zero(e.layers)],
+              e.spelling.empty() ? n : e.spelling);
+}
+
+static bool ends_with_folded(string_view s, string_view suffix) {
+  if (s.size() < suffix.size())
+    return false;
+  s.remove_prefix(s.size() - suffix.size());
+  return equal(s.begin(), s.end(), suffix.begin(), [](char a, char b) {
+    return (a >= 'A' and a <= 'Z' ? a - 'A' + 'a' : a) ==
+           (b >= 'A' and b <= 'Z' ? b - 'A' + 'a' : b);
+  });
+}
+
+vector<asset_file> list_files(string_view dir,
+                              const vector<string_view>& suffixes,
+                              size_t nthreads) {
+  nthreads = max<size_t>(nthreads, 1);
+  mutex m;
+  condition_variable wake;
+  vector<fs::path> pending = {fs::path(dir)};
+  size_t busy = 0;
+  vector<vector<asset_file>> found(nthreads);
+
+  // Workers take a directory at a time, and give back the subdirectories
+  // they find in it. They are done once there are none left and nobody is
+  // still reading one.
+  auto work = [&](size_t id) {
+    unique_lock lock(m);
+    while (true) {
+      wake.wait(lock, [&]() { return not pending.empty() or busy == 0; });
+      if (pending.empty())
+        return;
+      fs::path d = move(pending.back());
+      pending.pop_back();
+      ++busy;
+      lock.unlock();
+
+      vector<fs::path> subdirs;
+      error_code ec;
+      for (auto it = fs::directory_iterator(
+             d, fs::directory_options::skip_permission_denied, ec);
+           it != fs::directory_iterator(); it.increment(ec)) {
+        if (ec)
+          break;
+        if (it->is_directory(ec)) {
+          subdirs.push_back(it->path());
+          continue;
+        }
+        string path = it->path().generic_string();
+        if (not it->is_regular_file(ec) or
+            none_of(suffixes.begin(), suffixes.end(),
+                    [&path](string_view suffix) {
+                      return ends_with_folded(path, suffix);
+                    }))
+          continue;
+        uint64_t size = it->file_size(ec);
+        found[id].push_back({move(path), ec ? 0 : size});
+      }
+
+      lock.lock();
+      --busy;
+      for (auto& sub : subdirs)
+        pending.push_back(move(sub));
+      wake.notify_all();
+    }
+  };
+  vector<thread> threads;
+  for (size_t i = 1; i < nthreads; ++i)
+    threads.emplace_back(work, i);
+  work(0);
+  for (auto& t : threads)
+    t.join();
+
+  vector<asset_file> files;
+  for (auto& f : found)
+    move(f.begin(), f.end(), back_inserter(files));
+  sort(files.begin(), files.end(),
+       [](const auto& a, const auto& b) { return a.path < b.path; });
+  return files;
+}
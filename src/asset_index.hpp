@@ -0,0 +1,84 @@
+#ifndef RRT_ASSET_INDEX_HPP
+#define RRT_ASSET_INDEX_HPP
+
+#include <cstdint>
+#include <string>
+#include <string_view>
+#include <unordered_map>
+#include <vector>
+
+// In-memory index of every file and directory below a mod directory, and
+// below the directories of the base game or parent mods it is layered over,
+// so that existence checks don't have to touch the filesystem once it is
+// built. Layers are searched in the order they were added, the mod (the
+// current directory) first, and the index keeps which of them have each
+// path.
+class asset_index {
+public:
+  // Adds a layer below those added so far. Returns -1 if there are too
+  // many, with errno set.
+  int add_layer(std::string_view root);
+
+  // Walks the `dir` tree (relative to the root of every layer), one thread
+  // per top-level subdirectory.
+  void build(std::string_view dir = "data");
+
+  // Checks whether `path` exists the way the game would resolve it. Paths
+  // outside of the indexed directory fall back to the filesystem.
+  bool exists(std::string_view path) const;
+
+  // The first layer that has `path`, or -1 if none does.
+  int layer(std::string_view path) const;
+
+  // The path `path` resolves to on disk, or an empty string if it doesn't
+  // exist.
+  std::string resolve(std::string_view path) const;
+
+  // Keep the index in sync with changes made to the mod after it was built.
+  // Removing a directory removes everything below it, and uncovers what the
+  // layers below have there.
+  void add(std::string_view path);
+  void remove(std::string_view path, bool directory);
+
+  size_t size() const { return paths.size(); }
+  size_t layer_count() const { return roots.size(); }
+  const std::string& layer_root(size_t layer) const { return roots[layer]; }
+
+  // Normalizes a path the way the (Windows) game does: backslashes become
+  // slashes, ASCII is case-folded, and redundant separators are dropped.
+  static std::string normalize(std::string_view path);
+
+private:
+  struct entry {
+
+    // One bit per layer that has the path.
+    uint32_t layers;
+
+    // How it is spelt on disk in the first of them, if that differs.
+    std::string spelling;
+  };
+
+  bool indexed(std::string_view n) const;
+  std::string spelling_in(size_t layer, const std::string& n) const;
+  void add(size_t layer, std::string_view path);
+
+  std::string indexed_dir;
+  std::vector<std::string> roots = {""};
+  std::unordered_map<std::string, entry> paths;
+};
+
+// A regular file found by list_files(), and its size.
+struct asset_file {
+  std::string path;
+  uint64_t size;
+};
+
+// Lists the regular files below `dir` whose names end in one of `suffixes`
+// (ignoring case), sorted by path. The directories are shared out between
+// `nthreads` threads as they are found, so that one large subdirectory
+// doesn't hold up the walk.
+std::vector<asset_file>
+list_files(std::string_view dir, const std::vector<std::string_view>& suffixes,
+           size_t nthreads);
+
+#endif
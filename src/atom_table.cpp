@@ -0,0 +1,45 @@
+#include "atom_table.hpp"
+
+#include <mutex>
+
+using namespace std;
+
+atom_table atoms;
+
+atom_table::atom_table() {
+  intern("default");
+  intern("slave");
+}
+
+atom atom_table::intern(string_view name) {
+  {
+    shared_lock l(m);
+    if (auto it = ids.find(name); it != ids.end())
+      return it->second;
+  }
+  unique_lock l(m);
+  if (auto it = ids.find(name); it != ids.end())
+    return it->second;
+  atom a = static_cast<atom>(names.size());
+
+  // Deque elements never move, so the key can point at the stored name.
+  names.emplace_back(name);
+  ids.emplace(names.back(), a);
+  return a;
+}
+
+atom atom_table::find(string_view name) const {
+  shared_lock l(m);
+  auto it = ids.find(name);
+  return it == ids.end() ? no_atom : it->second;
+}
+
+string_view atom_table::name(atom a) const {
+  shared_lock l(m);
+  return names[a];
+}
+
+size_t atom_table::size() const {
+  shared_lock l(m);
+  return names.size();
+}
@@ -0,0 +1,43 @@
+#ifndef RRT_ATOM_TABLE_HPP
+#define RRT_ATOM_TABLE_HPP
+
+#include <cstdint>
+#include <deque>
+#include <shared_mutex>
+#include <string>
+#include <string_view>
+#include <unordered_map>
+
+// Dense ID of an interned name.
+using atom = uint32_t;
+
+constexpr atom no_atom = UINT32_MAX;
+
+// Always interned first, as they are compared against everywhere.
+constexpr atom default_owner = 0;
+constexpr atom slave_owner = 1;
+
+// Interns names which repeat throughout the definition files (factions,
+// models, dictionaries), so they can be stored and compared as integers.
+class atom_table {
+public:
+  atom_table();
+
+  atom intern(std::string_view name);
+
+  // Returns `no_atom` if `name` was never interned.
+  atom find(std::string_view name) const;
+
+  std::string_view name(atom a) const;
+
+  size_t size() const;
+
+private:
+  mutable std::shared_mutex m;
+  std::deque<std::string> names;
+  std::unordered_map<std::string_view, atom> ids;
+};
+
+extern atom_table atoms;
+
+#endif
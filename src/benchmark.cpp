@@ -0,0 +1,196 @@
+#include <dcc/errno.hpp>
+#include <dcc/logger.hpp>
+#include <algorithm>
+#include <chrono>
+#include <filesystem>
+#include <fstream>
+#include <memory>
+#include <string>
+#include <string_view>
+#include <vector>
+
+#include "common.hpp"
+#include "corpus.hpp"
+#include "thread_pool.hpp"
+#include "verification.hpp"
+
+using namespace std;
+using namespace dcc;
+namespace fs = std::filesystem;
+
+// Times the parsers and verification passes on synthetic mods of growing
+// size, see write_corpus(), and writes one JSON object per measurement:
+//
+//   benchmark [--scales 1,4,16] [--repeat N] [--jobs N] [--missing FRACTION]
+//             [--output FILE] [--dir DIR] [--keep]
+//
+// Every measurement runs `repeat` times, and the fastest, median and mean
+// runs are reported, so that runs of different revisions can be compared.
+
+struct measurement {
+  string name;
+  size_t scale;
+  size_t entries;
+  vector<double> ms;
+};
+
+template <class F> vector<double> time_runs(size_t repeat, F fn) {
+  vector<double> ms;
+  for (size_t i = 0; i < repeat; ++i) {
+    auto start = chrono::steady_clock::now();
+    fn();
+    chrono::duration<double, milli> took = chrono::steady_clock::now() - start;
+    ms.push_back(took.count());
+  }
+  return ms;
+}
+
+string to_json(const measurement& m) {
+  vector<double> sorted = m.ms;
+  sort(sorted.begin(), sorted.end());
+  double mean = 0;
+  for (double ms : sorted)
+    mean += ms / sorted.size();
+  return fmt::format(
+    "{{\"benchmark\": \"{}\", \"scale\": {}, \"entries\": {}, \"jobs\": {}, "
+    "\"repeat\": {}, \"min_ms\": {:.3f}, \"median_ms\": {:.3f}, "
+    "\"mean_ms\": {:.3f}}}",
+    m.name, m.scale, m.entries, g::jobs, sorted.size(), sorted.front(),
+    sorted[sorted.size() / 2], mean);
+}
+
+vector<size_t> parse_scales(string_view s) {
+  vector<size_t> scales;
+  while (not s.empty()) {
+    size_t comma = s.find(',');
+    scales.push_back(stoul(string(s.substr(0, comma))));
+    s = comma == string_view::npos ? "" : s.substr(comma + 1);
+  }
+  return scales;
+}
+
+// Generates the corpus for `scale` in `dir`, and measures everything on it.
+vector<measurement> run(const corpus_spec& base, size_t scale,
+                        const fs::path& dir, size_t repeat) {
+  corpus_spec spec = base.scaled(scale);
+  error_code ec;
+  fs::remove_all(dir, ec);
+  dcc_logmsg("Generating corpus of {} units in {}...",
+             sgr::semiunique(spec.units), sgr::file(dir.string()));
+  if (write_corpus(dir.string(), spec) == -1) {
+    dcc_logerr("Could not write corpus to {}: {}.", sgr::file(dir.string()),
+               errmsg());
+    exit(-1);
+  }
+  fs::path cwd = fs::current_path();
+  fs::current_path(dir);
+
+  vector<measurement> results;
+  auto measure = [&](string_view name, size_t entries, auto fn) {
+    results.push_back({string(name), scale, entries, time_runs(repeat, fn)});
+    dcc_loginf("{:<28} {:>10.3f} ms", name,
+               *min_element(results.back().ms.begin(),
+                            results.back().ms.end()));
+  };
+
+  mod_state st;
+  measure("index", 0, []() { g::assets.build("data"); });
+  results.back().entries = g::assets.size();
+  measure("parse_units", spec.units,
+          [&st]() { st.units = parse_units(g::edu_filename); });
+  measure("parse_battle_models", spec.battle_models, [&st]() {
+    st.battle_models = parse_battle_models(g::dmb_filename);
+  });
+  measure("parse_strat_model_entries", spec.strat_models, [&st]() {
+    st.strat_model_entries = parse_strat_model_entries(g::dc_filename);
+  });
+  measure("parse_strat_models", spec.strat_models, [&st]() {
+    st.strat_models = parse_strat_models(g::dms_filename);
+  });
+  measure("parse_banners", spec.banners,
+          [&st]() { st.banners = parse_banners(g::db_filename); });
+  measure("parse_factions", spec.factions,
+          [&st]() { st.factions = parse_factions(g::dsf_filename); });
+  measure("parse_recruitments", spec.units, [&st]() {
+    st.recruitments = parse_recruitments(g::edb_filename);
+  });
+  st.export_units = read_export_units();
+  st.en_strings = read_en_strings();
+
+  unit_rosters rosters = rosters_of(st);
+  measure("verify_units", spec.units, [&st, &rosters]() {
+    verify_units(st.units, st.battle_models, st.export_units, st.en_strings,
+                 rosters);
+  });
+  measure("verify_strat_models", spec.strat_models, [&st]() {
+    verify_strat_models(st.strat_model_entries, st.strat_models);
+  });
+  measure("verify_banners", spec.banners,
+          [&st]() { verify_banners(st.banners); });
+
+  fs::current_path(cwd);
+  return results;
+}
+
+int main(int argc, char** argv) {
+  vector<size_t> scales = {1, 4, 16};
+  size_t repeat = 5;
+  string output = "benchmark.json";
+  fs::path dir = fs::temp_directory_path() / "rrtw-benchmark";
+  bool keep = false;
+  corpus_spec spec;
+  for (int i = 1; i < argc; ++i) {
+    string s = argv[i];
+    auto value = [&]() -> string {
+      if (i + 1 == argc) {
+        dcc_logerr("{} needs a value.", s);
+        exit(-1);
+      }
+      return argv[++i];
+    };
+    if (s == "--scales")
+      scales = parse_scales(value());
+    else if (s == "--repeat")
+      repeat = max<size_t>(1, stoul(value()));
+    else if (s == "--jobs")
+      g::jobs = stoul(value());
+    else if (s == "--missing")
+      spec.missing = stod(value());
+    else if (s == "--output")
+      output = value();
+    else if (s == "--dir")
+      dir = value();
+    else if (s == "--keep")
+      keep = true;
+    else {
+      dcc_logerr("Unknown option {}.", s);
+      exit(-1);
+    }
+  }
+
+  ofstream out(output, ios::binary);
+  if (not out) {
+    dcc_logerr("Could not open {} for writing: {}.", sgr::file(output),
+               errmsg());
+    exit(-1);
+  }
+  g::quiet = true;
+  if (g::jobs != 1) {
+    g::pool = make_unique<thread_pool>(g::jobs);
+    g::jobs = g::pool->size();
+  }
+  set_parse_threads(g::jobs);
+  dir = fs::absolute(dir);
+  for (size_t scale : scales) {
+    fs::path scale_dir = dir / fmt::format("scale{}", scale);
+    for (const auto& m : run(spec, scale, scale_dir, repeat))
+      out << to_json(m) << '\n';
+    if (not keep)
+      fs::remove_all(scale_dir);
+  }
+  error_code ec;
+  if (not keep)
+    fs::remove(dir, ec);
+  dcc_logmsg("Results written to {}.", sgr::file(output));
+  return 0;
+}
@@ -0,0 +1,83 @@
+#include "cas_model.hpp"
+
+#include <algorithm>
+#include <bit>
+#include <cmath>
+#include <cstdint>
+#include <dcc/logger.hpp>
+
+using namespace std;
+
+// Longer than any path the game accepts.
+static constexpr size_t max_name = 255;
+
+static uint32_t le32(string_view s, size_t at) {
+  uint32_t v = 0;
+  for (size_t i = 0; i < 4; ++i)
+    v |= uint32_t(uint8_t(s[at + i])) << (i * 8);
+  return v;
+}
+
+static bool is_name_char(char c) { return c > ' ' and c < '\x7f'; }
+
+// Some exporters count the terminating NUL of names, some don't.
+static string_view trim_nul(string_view name) {
+  if (not name.empty() and name.back() == '\0')
+    name.remove_suffix(1);
+  return name;
+}
+
+static bool is_texture_name(string_view name) {
+  if (name.size() < 5)
+    return false;
+  string ext(name.substr(name.size() - 4));
+  transform(ext.begin(), ext.end(), ext.begin(),
+            [](char c) { return c >= 'A' and c <= 'Z' ? c - 'A' + 'a' : c; });
+  return ext == ".tga" or ext == ".dds";
+}
+
+string scan_cas(string_view data, cas_model& model) {
+  if (data.size() < 8)
+    return fmt::format("truncated, {} bytes", data.size());
+  model.version = bit_cast<float>(le32(data, 0));
+  if (not isfinite(model.version) or model.version <= 0 or
+      model.version > 100)
+    return fmt::format("not a .cas file (version field {:#010x})",
+                       le32(data, 0));
+
+  // A name that runs past the end of the file can only mean that the file
+  // was cut short.
+  uint32_t len = le32(data, 4);
+  if (len > 0 and len <= max_name) {
+    if (8 + len > data.size())
+      return fmt::format("truncated, {} bytes", data.size());
+    string_view name = trim_nul(data.substr(8, len));
+    if (not name.empty() and all_of(name.begin(), name.end(), is_name_char))
+      model.skeleton = name;
+  }
+
+  // Rather than walking every section, look for the extensions and check
+  // that a length leads up to each: the bytes of a name are printable, and
+  // the last byte of a length below 256 isn't.
+  for (size_t dot = data.find('.', 8); dot != string_view::npos;
+       dot = data.find('.', dot + 1)) {
+    size_t end = min(dot + 4, data.size());
+    size_t begin = dot;
+    while (begin > 8 and dot - begin < max_name and
+           is_name_char(data[begin - 1]))
+      --begin;
+    string_view name = data.substr(begin, end - begin);
+    if (not is_texture_name(name))
+      continue;
+    uint32_t prefix = le32(data, begin - 4);
+    bool counts_nul = end < data.size() and data[end] == '\0' and
+                      prefix == name.size() + 1;
+    if (prefix != name.size() and not counts_nul)
+      continue;
+    string texture(name);
+    if (find(model.textures.begin(), model.textures.end(), texture) ==
+        model.textures.end())
+      model.textures.push_back(move(texture));
+  }
+  return "";
+}
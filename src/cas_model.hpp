@@ -0,0 +1,24 @@
+#ifndef RRT_CAS_MODEL_HPP
+#define RRT_CAS_MODEL_HPP
+
+#include <string>
+#include <string_view>
+#include <vector>
+
+// What a .cas model embeds: the version of its format, the name of the
+// skeleton it is rigged to, and the textures it names.
+struct cas_model {
+  float version = 0;
+  std::string skeleton = "";
+  std::vector<std::string> textures;
+};
+
+// Scans the contents of a .cas file. The format isn't documented, so only
+// what every version shares is relied upon: a little-endian float version
+// first, and names stored as a 32-bit length followed by that many
+// characters, the skeleton's straight after the version. Texture names are
+// told apart by their extension (.tga or .dds), and each is listed once.
+// Returns what's wrong with the model, or an empty string if nothing is.
+std::string scan_cas(std::string_view data, cas_model& model);
+
+#endif
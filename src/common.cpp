@@ -1,5 +1,10 @@
 #include "common.hpp"
+#include "keyword_table.hpp"
+#include "mapped_file.hpp"
+#include "profiler.hpp"
 
+#include <algorithm>
+#include <atomic>
 #include <cassert>
 #include <cstdio>
 #include <dcc/file.hpp>
@@ -7,31 +12,55 @@
 #include <fstream>
 #include <regex>
 #include <sstream>
+#include <thread>
 #include <unordered_set>
 
 using namespace std;
 using namespace dcc;
 
+pmr::memory_resource* parse_arena::lane() {
+  lock_guard lock(m);
+  return &lanes.emplace_back();
+}
+
+// Where to parse to, with or without an arena.
+static pmr::memory_resource* lane(parse_arena* arena) {
+  return arena ? arena->lane() : pmr::get_default_resource();
+}
+
+// The dcc parsers, which the ones below are checked against by
+// --compare-parsers.
+
 class unit_parser : public parser<unit> {
 public:
   unit_parser(string_view path) : parser(path) {
-    partition = "dictionary";
+    partition = "type";
     comment = ";";
+    entries["type"] = [this]() {
+      t.lineno = lineno();
+      t.type = entry();
+    };
     entries["dictionary"] = [this]() {
       t.lineno = lineno();
       t.dictionary = entry();
     };
 
     entries["attributes"] = [this]() {
-      t.attributes = strtok(entry());
+      vector<string> attributes = strtok(entry());
+      t.attributes.assign(attributes.begin(), attributes.end());
       for (const auto& attr : t.attributes) {
         if (attr == "mercenary_unit")
           t.mercenary = true;
       }
     };
-    entries["ownership"] = [this]() { t.owners = strtok(entry()); };
-    entries["officer"] = [this]() { t.officers.push_back(entry()); };
-    entries["soldier"] = [this]() { t.soldiers.push_back(strtok(entry())[0]); };
+    entries["ownership"] = [this]() {
+      for (const auto& owner : strtok(entry()))
+        t.owners.push_back(atoms.intern(owner));
+    };
+    entries["officer"] = [this]() { t.officers.emplace_back(entry()); };
+    entries["soldier"] = [this]() {
+      t.soldiers.emplace_back(strtok(entry())[0]);
+    };
     sets["soldiers"] = [this]() {
       const vector<string> soldiers = strtok(set().nested_sets[0].entries);
       t.soldiers.insert(t.soldiers.end(), soldiers.begin(), soldiers.end());
@@ -48,178 +77,721 @@ public:
       t.dictionary = entry();
       t.lineno = lineno();
     };
-    entries["texture"] = [this]() {
-      vector<string> owner_and_path = strtok(entry());
-      texture tex;
-      tex.lineno = lineno();
-      if (owner_and_path.size() == 1) {
-        tex.path = entry();
-        t.textures["default"] = tex;
-      }
-      else {
-        tex.path = owner_and_path[1];
-        t.textures[owner_and_path[0]] = tex;
-      }
-    };
-    entries["pbr_texture"] = [this]() {
-      vector<string> owner_and_path = strtok(entry());
-      texture tex;
-      tex.lineno = lineno();
-      if (owner_and_path.size() == 1) {
-        tex.path = entry();
-        t.pbr_textures["default"] = tex;
-      }
-      else {
-        tex.path = owner_and_path[1];
-        t.pbr_textures[owner_and_path[0]] = tex;
-      }
-    };
+    entries["texture"] = [this]() { set_texture(t.textures); };
+    entries["pbr_texture"] = [this]() { set_texture(t.pbr_textures); };
     entries["model_flexi"] = [this]() {
-      t.model_paths.insert(strtok(entry())[0]);
+      t.model_paths.emplace(strtok(entry())[0]);
     };
     entries["model_flexi_m"] = [this]() {
-      t.model_paths.insert(strtok(entry())[0]);
+      t.model_paths.emplace(strtok(entry())[0]);
     };
     entries["no_variation model_flexi"] = [this]() {
-      t.model_paths.insert(strtok(entry())[0]);
+      t.model_paths.emplace(strtok(entry())[0]);
     };
     entries["no_variation model_flexi_m"] = [this]() {
-      t.model_paths.insert(strtok(entry())[0]);
-    };
-    key = [this]() { return t.dictionary; };
-  };
-};
-
-class character_parser : public parser<strat_model_entry, string> {
-public:
-  character_parser(string_view path) : parser(path) {
-    partition = "type";
-    comment = ";";
-    entries["type"] = [this]() {
-      t.type = entry();
-      t.lineno = lineno();
-    };
-    entries["faction"] = [this]() { t.last_faction = entry(); };
-    entries["strat_model"] = [this]() { t.models[t.last_faction] = entry(); };
-    entries["strat_card"] = [this]() {
-      t.strat_cards[t.last_faction] = entry();
-    };
-  };
-};
-
-class strat_model_parser : public parser<strat_model, string> {
-public:
-  strat_model_parser(string_view path) : parser(path) {
-    partition = "type";
-    comment = ";";
-    entries["type"] = [this]() {
-      t.lineno = lineno();
-      t.type = entry();
-    };
-    entries["model_flexi"] = [this]() { t.path = strtok(entry())[0]; };
-    entries["no_variation model_flexi"] = [this]() {
-      t.nv_path = strtok(entry())[0];
-    };
-    entries["texture"] = [this]() {
-      vector<string> owner_and_path = strtok(entry());
-      texture tex;
-      tex.lineno = lineno();
-      if (owner_and_path.size() == 1) {
-        tex.path = entry();
-        t.textures["default"] = tex;
-      }
-      else {
-        tex.path = owner_and_path[1];
-        t.textures[owner_and_path[0]] = tex;
-      }
-    };
-    entries["pbr_texture"] = [this]() {
-      vector<string> owner_and_path = strtok(entry());
-      texture tex;
-      tex.lineno = lineno();
-      if (owner_and_path.size() == 1) {
-        tex.path = entry();
-        t.pbr_textures["default"] = tex;
-      }
-      else {
-        tex.path = owner_and_path[1];
-        t.pbr_textures[owner_and_path[0]] = tex;
-      }
+      t.model_paths.emplace(strtok(entry())[0]);
     };
-    key = [this]() { return t.type; };
+    key = [this]() { return string(t.dictionary); };
   };
-};
 
-class banner_parser : public parser<banner> {
-public:
-  banner_parser(string_view path) : parser(path) {
-    partition = "banner";
-    comment = ";";
-    entries["banner"] = [this]() {
-      t.type = entry();
-      t.lineno = lineno();
-    };
-    entries["standard_texture"] = [this]() {
-      t.texture_paths.insert(fmt::format("data/{}.dds", entry()));
-    };
-    entries["rebels_texture"] = [this]() {
-      t.texture_paths.insert(fmt::format("data/{}.dds", entry()));
-    };
-    entries["ally_texture"] = [this]() {
-      t.texture_paths.insert(fmt::format("data/{}.dds", entry()));
-    };
-    entries["routing_texture"] = [this]() {
-      t.texture_paths.insert(fmt::format("data/{}.dds", entry()));
-    };
+private:
+  void set_texture(texture_map<texture>& textures) {
+    vector<string> owner_and_path = strtok(entry());
+    texture tex;
+    tex.lineno = lineno();
+    if (owner_and_path.size() == 1) {
+      tex.path = entry();
+      textures.set(default_owner, tex);
+    }
+    else {
+      tex.path = owner_and_path[1];
+      textures.set(atoms.intern(owner_and_path[0]), tex);
+    }
   }
 };
 
-vector<unit> parse_units(string_view edu_path) {
+vector<unit> parse_units_with_dcc(string_view edu_path) {
+  profiler::span span("parse_units");
   unit_parser p(edu_path);
   vector<unit> units;
   if (p.parse(units) == -1) {
     dcc_logerr("Could not parse {}.", sgr::file(edu_path));
     exit(-1);
   }
+  prof.count_parsed(edu_path, units.size());
   return units;
 }
 
-unordered_map<string, battle_model> parse_battle_models(string_view dmb_path) {
+unordered_map<string, battle_model>
+parse_battle_models_with_dcc(string_view dmb_path) {
+  profiler::span span("parse_battle_models");
   battle_model_parser p(dmb_path);
   unordered_map<string, battle_model> battle_models;
   if (p.parse(battle_models) == -1) {
     dcc_logerr("Could not parse {}.", sgr::file(dmb_path));
     exit(-1);
   }
+  prof.count_parsed(dmb_path, battle_models.size());
   return battle_models;
 }
 
-unordered_map<string, strat_model> parse_strat_models(string_view dms_path) {
-  strat_model_parser p(dms_path);
-  unordered_map<string, strat_model> strat_models;
-  if (p.parse(strat_models) == -1) {
-    dcc_logerr("Could not parse {}.", sgr::file(dms_path));
+// Walks a mapped definition file line by line, splitting each line into its
+// keyword and value the same way the dcc parsers do, but without copying.
+class line_reader {
+public:
+  // `first_line` is the number of lines before `buf` in its file, if it is
+  // only a part of it.
+  line_reader(string_view buf, char comment, size_t first_line = 0)
+      : buf(buf), comment(comment), ln(first_line) {}
+
+  // Moves to the next line that is not empty once comments are stripped.
+  bool next() {
+    while (pos < buf.size()) {
+      size_t end = buf.find('\n', pos);
+      if (end == string_view::npos)
+        end = buf.size();
+      string_view line = buf.substr(pos, end - pos);
+      pos = end + 1;
+      ++ln;
+      line = trim(line.substr(0, line.find(comment)));
+      if (line.empty())
+        continue;
+      size_t kwend = line.find_first_of(" \t");
+      kw = line.substr(0, kwend);
+
+      // Two-word keywords are looked up with a single space between them,
+      // however far apart they are.
+      if (kw == "no_variation" and kwend != npos) {
+        size_t second = line.find_first_not_of(" \t", kwend);
+        size_t after = line.find_first_of(" \t", second);
+        if (second == kwend + 1 and line[kwend] == ' ')
+          kw = line.substr(0, after);
+        else
+          kw = joined = fmt::format("no_variation {}",
+                                    line.substr(second, after - second));
+        kwend = after;
+      }
+      val = kwend == npos ? string_view() : trim(line.substr(kwend));
+      return true;
+    }
+    return false;
+  }
+
+  // Moves to the next line starting with `keyword`, the first of an entry.
+  bool next(string_view keyword) {
+    while (next())
+      if (kw == keyword)
+        return true;
+    return false;
+  }
+
+  // Consumes the brace-delimited block following the current line and
+  // returns what is inside of its outermost braces.
+  string_view block() {
+    size_t open = buf.find('{', pos);
+    if (open == npos)
+      return {};
+    size_t depth = 0;
+    for (size_t i = open; i < buf.size(); ++i) {
+      if (buf[i] == '\n')
+        ++ln;
+      else if (buf[i] == '{')
+        ++depth;
+      else if (buf[i] == '}' and --depth == 0) {
+        ln += count(buf.begin() + pos, buf.begin() + open, '\n');
+        pos = i + 1;
+        return buf.substr(open + 1, i - open - 1);
+      }
+    }
+    return {};
+  }
+
+  size_t lineno() const { return ln; }
+  string_view keyword() const { return kw; }
+  string_view value() const { return val; }
+
+  static string_view trim(string_view s) {
+    size_t b = s.find_first_not_of(" \t\r");
+    if (b == npos)
+      return {};
+    return s.substr(b, s.find_last_not_of(" \t\r") - b + 1);
+  }
+
+private:
+  static constexpr size_t npos = string_view::npos;
+  string_view buf;
+  char comment;
+  size_t pos = 0;
+  size_t ln;
+  string_view kw;
+  string_view val;
+
+  // The keyword, if it had to be put together.
+  string joined;
+};
+
+// Takes the next token of a value off its front, like dcc's strtok(), or
+// nothing once there are none left. Tokens are never empty otherwise.
+static string_view next_token(string_view& s,
+                              string_view delims = ", \t\r") {
+  size_t b = s.find_first_not_of(delims);
+  if (b == string_view::npos) {
+    s = {};
+    return {};
+  }
+  size_t e = min(s.find_first_of(delims, b), s.size());
+  string_view token = s.substr(b, e - b);
+  s.remove_prefix(e);
+  return token;
+}
+
+// Handles `texture` and `pbr_texture` lines, which may or may not name the
+// faction the texture is for.
+template <class Texture>
+static void add_texture(texture_map<Texture>& textures, const line_reader& r) {
+  using path_type = decltype(Texture::path);
+  auto path = [&textures](string_view p) {
+    if constexpr (is_same_v<path_type, string_view>)
+      return p;
+    else
+      return path_type(p, textures.resource());
+  };
+  string_view rest = r.value();
+  string_view owner = next_token(rest);
+  string_view owner_path = next_token(rest);
+  if (owner.empty())
+    return;
+  if (owner_path.empty())
+    textures.set(default_owner, {r.lineno(), path(r.value())});
+  else
+    textures.set(atoms.intern(owner), {r.lineno(), path(owner_path)});
+}
+
+// The first token of a value, or nothing if it is empty.
+static string_view first_token(string_view s) { return next_token(s); }
+
+// Maps a definition file for the parsers below, which copy what they keep.
+static mapped_file map_definitions(string_view path) {
+  mapped_file f;
+  if (f.open(path) == -1) {
+    dcc_logerr("Could not parse {}.", sgr::file(path));
     exit(-1);
   }
+  return f;
+}
+
+// A part of a definition file, and the number of lines before it.
+struct chunk {
+  string_view text;
+  size_t first_line;
+};
+
+// Chunks smaller than this aren't worth a thread of their own.
+static constexpr size_t min_chunk_size = 256 * 1024;
+
+// The threads the parsers may use, see set_parse_threads(), and how many of
+// those besides the threads the parsers were called on are free.
+static atomic<size_t> parse_threads = 1;
+static atomic<size_t> spare_threads = 0;
+
+void set_parse_threads(size_t n) {
+  parse_threads = max<size_t>(n, 1);
+  spare_threads = parse_threads - 1;
+}
+
+// Calls `fn(i)` for every `i` in [0, n), on this thread and on as many of
+// the spare threads as are free, at most one per call.
+template <class F>
+static void run_parallel(size_t n, F fn) {
+  size_t want = n == 0 ? 0 : n - 1;
+  size_t free = spare_threads.load();
+  while (not spare_threads.compare_exchange_weak(free,
+                                                 free - min(free, want)))
+    ;
+  size_t taken = min(free, want);
+  atomic<size_t> next = 0;
+  auto work = [&next, n, &fn]() {
+    for (size_t i; (i = next++) < n;)
+      fn(i);
+  };
+  vector<thread> threads;
+  for (size_t i = 0; i < taken; ++i)
+    threads.emplace_back(work);
+  work();
+  for (auto& t : threads)
+    t.join();
+  spare_threads += taken;
+}
+
+// Splits `buf` into a chunk per parse thread, each but the first starting at
+// a line whose first token is `keyword`, the one that starts entries, so that
+// the chunks can be parsed independently. Only the lines near the cuts are
+// read to find them, the rest only has newlines counted, in parallel.
+static vector<chunk> split_entries(string_view buf, string_view keyword) {
+  size_t n = min<size_t>(parse_threads, buf.size() / min_chunk_size + 1);
+  vector<size_t> cuts = {0};
+  for (size_t i = 1; i < n; ++i) {
+    size_t pos = max(buf.size() / n * i, cuts.back());
+    while ((pos = buf.find('\n', pos)) != string_view::npos) {
+      string_view line = buf.substr(++pos);
+      line.remove_prefix(min(line.find_first_not_of(" \t"), line.size()));
+      if (line.starts_with(keyword) and line.size() > keyword.size() and
+          (line[keyword.size()] == ' ' or line[keyword.size()] == '\t'))
+        break;
+    }
+    if (pos == string_view::npos)
+      break;
+    cuts.push_back(pos);
+  }
+  cuts.push_back(buf.size());
+
+  vector<size_t> newlines(cuts.size() - 1);
+  run_parallel(cuts.size() - 2, [&buf, &cuts, &newlines](size_t i) {
+    newlines[i] =
+      size_t(count(buf.begin() + cuts[i], buf.begin() + cuts[i + 1], '\n'));
+  });
+  vector<chunk> chunks;
+  size_t first_line = 0;
+  for (size_t i = 0; i + 1 < cuts.size(); ++i) {
+    chunks.push_back({buf.substr(cuts[i], cuts[i + 1] - cuts[i]), first_line});
+    first_line += newlines[i];
+  }
+  return chunks;
+}
+
+// Parses every chunk with `parse`, spread over the parse threads, and returns
+// the results in the order of the chunks.
+template <class F>
+static auto parse_chunks(const vector<chunk>& chunks, F parse) {
+  vector<decltype(parse(chunks[0]))> results(chunks.size());
+  run_parallel(chunks.size(),
+               [&](size_t i) { results[i] = parse(chunks[i]); });
+  return results;
+}
+
+// Each parser below starts at the first line of the first entry, and lines
+// before it are ignored, as with the dcc parsers.
+
+static constexpr keyword_table<7> edu_keywords({"type", "dictionary",
+                                                "attributes", "ownership",
+                                                "officer", "soldier",
+                                                "soldiers"});
+
+// An empty unit, or view of one, that allocates from `mr`.
+template <class Unit>
+static Unit empty_unit(pmr::memory_resource* mr) {
+  if constexpr (is_same_v<Unit, unit>)
+    return {false,
+            0,
+            pmr::string(mr),
+            pmr::string(mr),
+            pmr::vector<pmr::string>(mr),
+            pmr::vector<atom>(mr),
+            pmr::vector<pmr::string>(mr),
+            pmr::vector<pmr::string>(mr)};
+  else
+    return {};
+}
+
+// Fills either units or views of them. Units are built in place, so that
+// nothing is parsed twice.
+template <class Unit>
+static vector<Unit> read_units(string_view buf, size_t first_line,
+                               pmr::memory_resource* mr) {
+  vector<Unit> units;
+  line_reader r(buf, ';', first_line);
+  if (not r.next("type"))
+    return units;
+  Unit* t = nullptr;
+  do
+    dispatch(
+      edu_keywords, r.keyword(),
+      [&]() {
+        t = &units.emplace_back(empty_unit<Unit>(mr));
+        t->lineno = r.lineno();
+        t->type = r.value();
+      },
+      [&]() {
+        t->lineno = r.lineno();
+        t->dictionary = r.value();
+      },
+      [&]() {
+        t->attributes.clear();
+        string_view attrs = r.value();
+        for (string_view attr; not(attr = next_token(attrs)).empty();) {
+          t->attributes.emplace_back(attr);
+          if (attr == "mercenary_unit")
+            t->mercenary = true;
+        }
+      },
+      [&]() {
+        string_view owners = r.value();
+        for (string_view owner; not(owner = next_token(owners)).empty();)
+          t->owners.push_back(atoms.intern(owner));
+      },
+      [&]() { t->officers.emplace_back(r.value()); },
+      [&]() {
+        if (string_view soldier = first_token(r.value()); not soldier.empty())
+          t->soldiers.emplace_back(soldier);
+      },
+      [&]() {
+        string_view soldiers = r.block();
+        for (string_view soldier;
+             not(soldier = next_token(soldiers, ", \t\r\n{}")).empty();)
+          t->soldiers.emplace_back(soldier);
+      });
+  while (r.next());
+  return units;
+}
+
+// Splits export_descr_unit.txt at its entries to parse the parts in
+// parallel.
+template <class Unit>
+static vector<Unit> read_units(string_view buf, parse_arena* arena) {
+  auto parts =
+    parse_chunks(split_entries(buf, "type"), [arena](const chunk& c) {
+      return read_units<Unit>(c.text, c.first_line, lane(arena));
+    });
+  vector<Unit> units = move(parts[0]);
+  for (size_t i = 1; i < parts.size(); ++i)
+    units.insert(units.end(), make_move_iterator(parts[i].begin()),
+                 make_move_iterator(parts[i].end()));
+  return units;
+}
+
+static constexpr keyword_table<7> dmb_keywords(
+  {"type", "texture", "pbr_texture", "model_flexi", "model_flexi_m",
+   "no_variation model_flexi", "no_variation model_flexi_m"});
+
+// A battle model defined again, replacing the earlier definition as with the
+// dcc parsers.
+struct redefinition {
+  string name;
+  size_t first;
+  size_t again;
+};
+
+// Battle models are keyed by their own string, views by a view.
+template <class Model>
+using battle_model_map =
+  unordered_map<conditional_t<is_same_v<Model, battle_model>, string,
+                              string_view>,
+                Model>;
+
+// An empty battle model, or view of one, that allocates from `mr`.
+template <class Model>
+static Model empty_model(pmr::memory_resource* mr) {
+  if constexpr (is_same_v<Model, battle_model>)
+    return {0, pmr::string(mr), mr, mr,
+            pmr::unordered_set<pmr::string>(mr)};
+  else
+    return {};
+}
+
+// Models are moved into place rather than assigned, which would copy them
+// out of their arena.
+template <class Model>
+static void keep_last(battle_model_map<Model>& battle_models, Model&& t,
+                      vector<redefinition>& redefinitions) {
+  typename battle_model_map<Model>::key_type name(t.dictionary);
+  if (auto it = battle_models.find(name); it != battle_models.end()) {
+    redefinitions.push_back({string(name), it->second.lineno, t.lineno});
+    battle_models.erase(it);
+  }
+  battle_models.emplace(move(name), move(t));
+}
+
+// Fills either battle models or views of them. The models own their paths,
+// which are added in the order of the file either way.
+template <class Model>
+static battle_model_map<Model>
+read_battle_models(string_view buf, size_t first_line,
+                   vector<redefinition>& redefinitions,
+                   pmr::memory_resource* mr) {
+  battle_model_map<Model> battle_models;
+  line_reader r(buf, ';', first_line);
+  if (not r.next("type"))
+    return battle_models;
+  Model t = empty_model<Model>(mr);
+  bool in_entry = false;
+  auto model = [&]() {
+    if (string_view path = first_token(r.value()); not path.empty())
+      t.model_paths.emplace(path);
+  };
+  do
+    dispatch(
+      dmb_keywords, r.keyword(),
+      [&]() {
+        if (exchange(in_entry, true))
+          keep_last(battle_models, move(t), redefinitions);
+        t = empty_model<Model>(mr);
+        t.dictionary = r.value();
+        t.lineno = r.lineno();
+      },
+      [&]() { add_texture(t.textures, r); },
+      [&]() { add_texture(t.pbr_textures, r); }, model, model, model, model);
+  while (r.next());
+  keep_last(battle_models, move(t), redefinitions);
+  return battle_models;
+}
+
+// Splits descr_model_battle.txt at its entries to parse the parts in
+// parallel, and merges them in the order of the file, so that the last
+// definition of a model is still the one kept.
+template <class Model>
+static battle_model_map<Model> read_battle_models(string_view buf,
+                                                  string_view fname,
+                                                  parse_arena* arena) {
+  struct part {
+    battle_model_map<Model> battle_models;
+    vector<redefinition> redefinitions;
+  };
+  auto parts =
+    parse_chunks(split_entries(buf, "type"), [arena](const chunk& c) {
+      part p;
+      p.battle_models = read_battle_models<Model>(
+        c.text, c.first_line, p.redefinitions, lane(arena));
+      return p;
+    });
+  battle_model_map<Model> battle_models = move(parts[0].battle_models);
+  vector<redefinition> redefinitions = move(parts[0].redefinitions);
+  for (size_t i = 1; i < parts.size(); ++i) {
+    for (auto& [name, bm] : parts[i].battle_models)
+      keep_last(battle_models, move(bm), redefinitions);
+    redefinitions.insert(redefinitions.end(),
+                         parts[i].redefinitions.begin(),
+                         parts[i].redefinitions.end());
+  }
+  sort(redefinitions.begin(), redefinitions.end(),
+       [](const auto& a, const auto& b) { return a.again < b.again; });
+  for (const auto& r : redefinitions)
+    dcc_loginf("{} at {} is defined again at line {}, which is kept.",
+               sgr::semiunique(r.name),
+               sgr::file(fmt::format("{}:{}", fname, r.first)), r.again);
+  return battle_models;
+}
+
+vector<unit> parse_units(string_view edu_path, parse_arena* arena) {
+  profiler::span span("parse_units");
+  mapped_file edu = map_definitions(edu_path);
+  vector<unit> units = read_units<unit>(edu.view(), arena);
+  prof.count_parsed(edu.view().size(), units.size());
+  return units;
+}
+
+unordered_map<string, battle_model>
+parse_battle_models(string_view dmb_path, parse_arena* arena) {
+  profiler::span span("parse_battle_models");
+  mapped_file dmb = map_definitions(dmb_path);
+  auto battle_models =
+    read_battle_models<battle_model>(dmb.view(), dmb_path, arena);
+  prof.count_parsed(dmb.view().size(), battle_models.size());
+  return battle_models;
+}
+
+static constexpr keyword_table<5> dms_keywords({"type", "model_flexi",
+                                                "no_variation model_flexi",
+                                                "texture", "pbr_texture"});
+
+unordered_map<string, strat_model>
+parse_strat_models(string_view dms_path, parse_arena* arena) {
+  profiler::span span("parse_strat_models");
+  mapped_file dms = map_definitions(dms_path);
+  pmr::memory_resource* mr = lane(arena);
+  auto empty = [mr]() -> strat_model {
+    return {0, pmr::string(mr), pmr::string(mr), pmr::string(mr), mr, mr};
+  };
+  unordered_map<string, strat_model> strat_models;
+  line_reader r(dms.view(), ';');
+  if (r.next("type")) {
+    strat_model t = empty();
+    bool in_entry = false;
+    do
+      dispatch(
+        dms_keywords, r.keyword(),
+        [&]() {
+          if (exchange(in_entry, true))
+            strat_models.insert_or_assign(string(t.type), move(t));
+          t = empty();
+          t.lineno = r.lineno();
+          t.type = r.value();
+        },
+        [&]() { t.path = first_token(r.value()); },
+        [&]() { t.nv_path = first_token(r.value()); },
+        [&]() { add_texture(t.textures, r); },
+        [&]() { add_texture(t.pbr_textures, r); });
+    while (r.next());
+    strat_models.insert_or_assign(string(t.type), move(t));
+  }
+  prof.count_parsed(dms.view().size(), strat_models.size());
   return strat_models;
 }
 
-vector<strat_model_entry> parse_strat_model_entries(string_view dc_path) {
-  character_parser p(dc_path);
+static constexpr keyword_table<4> dc_keywords({"type", "faction",
+                                               "strat_model", "strat_card"});
+
+vector<strat_model_entry> parse_strat_model_entries(string_view dc_path,
+                                                    parse_arena* arena) {
+  profiler::span span("parse_strat_model_entries");
+  mapped_file dc = map_definitions(dc_path);
+  pmr::memory_resource* mr = lane(arena);
   vector<strat_model_entry> v;
-  if (p.parse(v) == -1) {
-    dcc_logerr("Could not parse {}.", sgr::file(dc_path));
-    exit(-1);
+  line_reader r(dc.view(), ';');
+  if (r.next("type")) {
+    strat_model_entry* t = nullptr;
+    do
+      dispatch(
+        dc_keywords, r.keyword(),
+        [&]() {
+          using strings =
+            pmr::unordered_map<pmr::string, pmr::string>;
+          t = &v.emplace_back(r.lineno(), pmr::string(r.value(), mr),
+                              pmr::string(mr), strings(mr), strings(mr));
+        },
+        [&]() { t->last_faction = r.value(); },
+        [&]() { t->models[t->last_faction] = r.value(); },
+        [&]() { t->strat_cards[t->last_faction] = r.value(); });
+    while (r.next());
   }
+  prof.count_parsed(dc.view().size(), v.size());
   return v;
 }
 
-vector<banner> parse_banners(string_view db_path) {
-  banner_parser p(db_path);
+static constexpr keyword_table<5> db_keywords({"banner", "standard_texture",
+                                               "rebels_texture",
+                                               "ally_texture",
+                                               "routing_texture"});
+
+vector<banner> parse_banners(string_view db_path, parse_arena* arena) {
+  profiler::span span("parse_banners");
+  mapped_file db = map_definitions(db_path);
+  pmr::memory_resource* mr = lane(arena);
   vector<banner> v;
-  if (p.parse(v) == -1) {
-    dcc_logerr("Could not parse {}.", sgr::file(db_path));
-    exit(-1);
+  line_reader r(db.view(), ';');
+  if (r.next("banner")) {
+    banner* t = nullptr;
+    auto texture = [&]() {
+      t->texture_paths.emplace(fmt::format("data/{}.dds", r.value()));
+    };
+    do
+      dispatch(
+        db_keywords, r.keyword(),
+        [&]() {
+          t = &v.emplace_back(r.lineno(), pmr::string(r.value(), mr),
+                              pmr::unordered_set<pmr::string>(mr));
+        },
+        texture, texture, texture, texture);
+    while (r.next());
   }
+  prof.count_parsed(db.view().size(), v.size());
   return v;
 }
+
+static constexpr keyword_table<2> dsf_keywords({"faction", "culture"});
+
+vector<faction> parse_factions(string_view dsf_path, parse_arena* arena) {
+  profiler::span span("parse_factions");
+  mapped_file dsf = map_definitions(dsf_path);
+  pmr::memory_resource* mr = lane(arena);
+  vector<faction> v;
+  line_reader r(dsf.view(), ';');
+  if (r.next("faction")) {
+    faction* t = nullptr;
+    do
+      dispatch(
+        dsf_keywords, r.keyword(),
+        [&]() {
+          t = &v.emplace_back(r.lineno(),
+                              pmr::string(first_token(r.value()), mr),
+                              pmr::string(mr));
+        },
+        [&]() { t->culture = first_token(r.value()); });
+    while (r.next());
+  }
+  prof.count_parsed(dsf.view().size(), v.size());
+  return v;
+}
+
+static constexpr keyword_table<2> edb_keywords({"recruit", "recruit_pool"});
+
+// Only recruitment is read, from wherever it is in the nested building
+// blocks. Units are named in quotes, as their types have spaces.
+vector<recruitment> parse_recruitments(string_view edb_path,
+                                       parse_arena* arena) {
+  profiler::span span("parse_recruitments");
+  mapped_file edb = map_definitions(edb_path);
+  pmr::memory_resource* mr = lane(arena);
+  vector<recruitment> v;
+  line_reader r(edb.view(), ';');
+  auto recruit = [&]() {
+    string_view value = r.value();
+    size_t open = value.find('"');
+    size_t close = value.find('"', open + 1);
+    if (open != string_view::npos and close != string_view::npos)
+      v.emplace_back(
+        r.lineno(), pmr::string(value.substr(open + 1, close - open - 1), mr));
+  };
+  while (r.next())
+    dispatch(edb_keywords, r.keyword(), recruit, recruit);
+  prof.count_parsed(edb.view().size(), v.size());
+  return v;
+}
+
+vector<unit_view> parse_units(const mapped_file& edu) {
+  profiler::span span("parse_units");
+  vector<unit_view> units = read_units<unit_view>(edu.view(), nullptr);
+  prof.count_parsed(edu.view().size(), units.size());
+  return units;
+}
+
+unordered_map<string_view, battle_model_view>
+parse_battle_models(const mapped_file& dmb) {
+  profiler::span span("parse_battle_models");
+  auto battle_models =
+    read_battle_models<battle_model_view>(dmb.view(), "descr_model_battle.txt",
+                                          nullptr);
+  prof.count_parsed(dmb.view().size(), battle_models.size());
+  return battle_models;
+}
+
+unit to_unit(const unit_view& u, pmr::memory_resource* mr) {
+  auto strings = [mr](const vector<string_view>& v) {
+    return pmr::vector<pmr::string>(v.begin(), v.end(), mr);
+  };
+  return {u.mercenary,
+          u.lineno,
+          pmr::string(u.type, mr),
+          pmr::string(u.dictionary, mr),
+          strings(u.attributes),
+          pmr::vector<atom>(u.owners.begin(), u.owners.end(), mr),
+          strings(u.soldiers),
+          strings(u.officers)};
+}
+
+battle_model to_battle_model(const battle_model_view& bm,
+                             pmr::memory_resource* mr) {
+  battle_model t = empty_model<battle_model>(mr);
+  t.lineno = bm.lineno;
+  t.dictionary = bm.dictionary;
+  for (const auto& [owner, tex] : bm.textures)
+    t.textures.set(owner, {tex.lineno, pmr::string(tex.path, mr)});
+  for (const auto& [owner, tex] : bm.pbr_textures)
+    t.pbr_textures.set(owner, {tex.lineno, pmr::string(tex.path, mr)});
+  for (const auto& path : bm.model_paths)
+    t.model_paths.emplace(path);
+  return t;
+}
+
+string json_escape(string_view s) {
+  string escaped;
+  escaped.reserve(s.size());
+  for (char c : s) {
+    if (c == '"' or c == '\\')
+      escaped += fmt::format("\\{}", c);
+    else if ((unsigned char)c < 0x20)
+      escaped += fmt::format("\\u{:04x}", (int)c);
+    else
+      escaped += c;
+  }
+  return escaped;
+}
@@ -1,73 +1,257 @@
 #ifndef RRT_COMMON_HPP
 #define RRT_COMMON_HPP
 
+#include <algorithm>
+#include <deque>
+#include <memory_resource>
+#include <mutex>
+#include <stdexcept>
 #include <string>
+#include <string_view>
 #include <unordered_map>
 #include <unordered_set>
+#include <utility>
 #include <vector>
 
+#include "atom_table.hpp"
+
+// Lets string-keyed containers be searched by string_view without copying.
+struct string_hash {
+  using is_transparent = void;
+  size_t operator()(std::string_view s) const {
+    return std::hash<std::string_view>{}(s);
+  }
+};
+
+// Where the parsers put the entities they parse: a monotonic arena per thread
+// parsing a file, all of them released at once with the parse_arena. Strings,
+// vectors and hash nodes are carved out of a few large blocks instead of
+// being a heap block each, and there is nothing to free one by one.
+class parse_arena {
+public:
+  // An arena for one more thread to allocate from.
+  std::pmr::memory_resource* lane();
+
+private:
+  std::mutex m;
+  std::deque<std::pmr::monotonic_buffer_resource> lanes;
+};
+
+// Textures of a model, keyed by owner. A model has only a handful of them, so
+// a sorted array is both smaller and faster to search than a hash map.
+template <class Texture>
+class texture_map {
+public:
+  using value_type = std::pair<atom, Texture>;
+  using const_iterator = typename std::pmr::vector<value_type>::const_iterator;
+
+  texture_map(
+    std::pmr::memory_resource* mr = std::pmr::get_default_resource())
+      : entries(mr) {}
+
+  bool contains(atom owner) const { return find(owner) != entries.end(); }
+
+  const Texture& at(atom owner) const {
+    auto it = find(owner);
+    if (it == entries.end())
+      throw std::out_of_range("texture_map::at");
+    return it->second;
+  }
+
+  // Adds the texture of `owner`, replacing any previous one.
+  void set(atom owner, Texture t) {
+    auto it = lower_bound(owner);
+    if (it != entries.end() and it->first == owner)
+      it->second = std::move(t);
+    else
+      entries.insert(it, {owner, std::move(t)});
+  }
+
+  std::pmr::memory_resource* resource() const {
+    return entries.get_allocator().resource();
+  }
+
+  const_iterator begin() const { return entries.begin(); }
+  const_iterator end() const { return entries.end(); }
+  size_t size() const { return entries.size(); }
+
+  bool operator==(const texture_map&) const = default;
+
+private:
+  typename std::pmr::vector<value_type>::iterator lower_bound(atom owner) {
+    return std::lower_bound(
+      entries.begin(), entries.end(), owner,
+      [](const value_type& e, atom a) { return e.first < a; });
+  }
+
+  const_iterator find(atom owner) const {
+    auto it = std::lower_bound(
+      entries.begin(), entries.end(), owner,
+      [](const value_type& e, atom a) { return e.first < a; });
+    return it != entries.end() and it->first == owner ? it : entries.end();
+  }
+
+  std::pmr::vector<value_type> entries;
+};
+
+// The entities below keep their strings and containers in the memory resource
+// they were parsed into, see parse_arena.
+
 struct unit {
   bool mercenary;
   size_t lineno;
-  std::string dictionary;
-  std::vector<std::string> attributes;
-  std::vector<std::string> owners;
-  std::vector<std::string> soldiers;
-  std::vector<std::string> officers;
+
+  // What export_descr_buildings.txt recruits the unit by.
+  std::pmr::string type;
+  std::pmr::string dictionary;
+  std::pmr::vector<std::pmr::string> attributes;
+  std::pmr::vector<atom> owners;
+  std::pmr::vector<std::pmr::string> soldiers;
+  std::pmr::vector<std::pmr::string> officers;
+
+  bool operator==(const unit&) const = default;
 };
 
 struct texture {
   size_t lineno;
-  std::string path;
+  std::pmr::string path;
+
+  bool operator==(const texture&) const = default;
 };
 
 struct battle_model {
   size_t lineno;
-  std::string dictionary;
-  std::unordered_map<std::string, texture> textures;
-  std::unordered_map<std::string, texture> pbr_textures;
-  std::unordered_set<std::string> model_paths;
+  std::pmr::string dictionary;
+  texture_map<texture> textures;
+  texture_map<texture> pbr_textures;
+  std::pmr::unordered_set<std::pmr::string> model_paths;
+
+  bool operator==(const battle_model&) const = default;
 };
 
 struct strat_model_entry {
   size_t lineno;
-  std::string type;
-  std::string last_faction;
-  std::unordered_map<std::string, std::string> models;
-  std::unordered_map<std::string, std::string> strat_cards;
+  std::pmr::string type;
+  std::pmr::string last_faction;
+  std::pmr::unordered_map<std::pmr::string, std::pmr::string> models;
+  std::pmr::unordered_map<std::pmr::string, std::pmr::string> strat_cards;
 };
 
 struct strat_model {
   size_t lineno;
-  std::string type;
-  std::string path;
-  std::string nv_path;
-  std::unordered_map<std::string, texture> textures;
-  std::unordered_map<std::string, texture> pbr_textures;
+  std::pmr::string type;
+  std::pmr::string path;
+  std::pmr::string nv_path;
+  texture_map<texture> textures;
+  texture_map<texture> pbr_textures;
 };
 
 struct banner {
   size_t lineno;
-  std::string type;
-  std::unordered_set<std::string> texture_paths;
+  std::pmr::string type;
+  std::pmr::unordered_set<std::pmr::string> texture_paths;
+};
+
+struct faction {
+  size_t lineno;
+  std::pmr::string name;
+  std::pmr::string culture;
+};
+
+// A `recruit` or `recruit_pool` line of export_descr_buildings.txt.
+struct recruitment {
+  size_t lineno;
+  std::pmr::string unit_type;
 };
 
+class mapped_file;
+
+// The following mirror `unit`, `texture` and `battle_model`, but point into a
+// mapped definition file instead of owning their strings.
+
+struct unit_view {
+  bool mercenary = false;
+  size_t lineno;
+  std::string_view type;
+  std::string_view dictionary;
+  std::vector<std::string_view> attributes;
+  std::vector<atom> owners;
+  std::vector<std::string_view> soldiers;
+  std::vector<std::string_view> officers;
+};
+
+struct texture_view {
+  size_t lineno;
+  std::string_view path;
+};
+
+struct battle_model_view {
+  size_t lineno;
+  std::string_view dictionary;
+  texture_map<texture_view> textures;
+  texture_map<texture_view> pbr_textures;
+  std::unordered_set<std::string_view> model_paths;
+};
+
+unit to_unit(const unit_view& u,
+             std::pmr::memory_resource* mr = std::pmr::get_default_resource());
+battle_model to_battle_model(
+  const battle_model_view& bm,
+  std::pmr::memory_resource* mr = std::pmr::get_default_resource());
+
+// Escapes `s` for use inside of a JSON string.
+std::string json_escape(std::string_view s);
+
 const std::string get_parent_dir(std::string_view path);
 
 // Finds the mod root directory from given path.
 const std::string get_mod_root_dir(std::string_view path);
 
-std::vector<unit> parse_units(std::string_view export_descr_unit_fname);
+// Lets the parsers of large files use up to `n` threads at a time, all files
+// together, counting the ones they are called on. The default, 1, parses
+// each file on the thread that asked for it.
+void set_parse_threads(size_t n);
+
+// The parsers of owning entities put them in `arena`, or on the heap without
+// one.
+
+std::vector<unit> parse_units(std::string_view export_descr_unit_fname,
+                              parse_arena* arena = nullptr);
+
+// Parses a mapped export_descr_unit.txt without copying any of it.
+std::vector<unit_view> parse_units(const mapped_file& export_descr_unit);
 
 std::unordered_map<std::string, battle_model>
-parse_battle_models(std::string_view descr_model_battle_fname);
+parse_battle_models(std::string_view descr_model_battle_fname,
+                    parse_arena* arena = nullptr);
+
+// Parses a mapped descr_model_battle.txt without copying any of it.
+std::unordered_map<std::string_view, battle_model_view>
+parse_battle_models(const mapped_file& descr_model_battle);
 
 std::vector<strat_model_entry>
-parse_strat_model_entries(std::string_view descr_model_battle_fname);
+parse_strat_model_entries(std::string_view descr_model_battle_fname,
+                          parse_arena* arena = nullptr);
 
 std::unordered_map<std::string, strat_model>
-parse_strat_models(std::string_view descr_model_strat_fname);
+parse_strat_models(std::string_view descr_model_strat_fname,
+                   parse_arena* arena = nullptr);
+
+std::vector<banner> parse_banners(std::string_view descr_banners_fname,
+                                  parse_arena* arena = nullptr);
 
-std::vector<banner> parse_banners(std::string_view descr_banners_fname);
+std::vector<faction> parse_factions(std::string_view descr_sm_factions_fname,
+                                    parse_arena* arena = nullptr);
+
+std::vector<recruitment>
+parse_recruitments(std::string_view export_descr_buildings_fname,
+                   parse_arena* arena = nullptr);
+
+// The same as parse_units() and parse_battle_models(), with the dcc parsers
+// they are checked against.
+std::vector<unit>
+parse_units_with_dcc(std::string_view export_descr_unit_fname);
+std::unordered_map<std::string, battle_model>
+parse_battle_models_with_dcc(std::string_view descr_model_battle_fname);
 
 #endif
@@ -0,0 +1,302 @@
+#include "corpus.hpp"
+
+#include <bit>
+#include <cerrno>
+#include <dcc/logger.hpp>
+#include <filesystem>
+#include <fstream>
+#include <random>
+#include <string>
+#include <unordered_set>
+#include <vector>
+
+#include "encoding.hpp"
+
+using namespace std;
+namespace fs = std::filesystem;
+
+corpus_spec corpus_spec::scaled(size_t factor) const {
+  corpus_spec s = *this;
+  s.units *= factor;
+  s.battle_models *= factor;
+  s.strat_models *= factor;
+  s.banners *= factor;
+  return s;
+}
+
+namespace {
+
+  void put32(string& s, uint32_t v) {
+    for (int i = 0; i < 4; ++i)
+      s += char(v >> (i * 8) & 0xff);
+  }
+
+  // A 4x4 DXT1 texture, without mips.
+  string dds_image() {
+    string s = "DDS ";
+    put32(s, 124);
+    put32(s, 0x1007);
+    put32(s, 4);
+    put32(s, 4);
+    put32(s, 8);
+    s.append(52, '\0');
+    put32(s, 32);
+    put32(s, 0x4);
+    s += "DXT1";
+    s.append(20, '\0');
+    put32(s, 0x1000);
+    s.append(16, '\0');
+    s.append(8, '\0');
+    return s;
+  }
+
+  // A single 32-bit pixel.
+  string tga_image() {
+    string s(18, '\0');
+    s[2] = 2;
+    s[12] = 1;
+    s[14] = 1;
+    s[16] = 32;
+    s[17] = 8;
+    s.append(4, '\xff');
+    return s;
+  }
+
+  // A model rigged to `skeleton` that names `textures`, with some filler
+  // standing in for its geometry.
+  string cas_model_file(string_view skeleton,
+                        const vector<string>& textures) {
+    auto put_name = [](string& s, string_view name) {
+      put32(s, uint32_t(name.size()));
+      s += name;
+    };
+    string s;
+    put32(s, bit_cast<uint32_t>(3.0f));
+    put_name(s, skeleton);
+    s.append(64, '\0');
+    for (const auto& t : textures)
+      put_name(s, t);
+    s.append(64, '\0');
+    return s;
+  }
+
+  class corpus_writer {
+  public:
+    corpus_writer(string_view root, const corpus_spec& spec)
+      : root(root), spec(spec), rng(spec.seed) {}
+
+    // Decides whether the next referenced asset or tag is left out.
+    bool present() { return coin(rng) >= spec.missing; }
+
+    // Creates a file at `path` (relative to the mod root), unless it is one
+    // of the missing ones. Unless given `contents`, images get the smallest
+    // valid ones, and anything else is left empty.
+    int touch(const string& path, string_view contents = "") {
+      if (not present())
+        return 0;
+      if (not contents.empty())
+        return write(path, contents);
+      if (path.ends_with(".dds"))
+        return write(path, dds_image());
+      if (path.ends_with(".tga"))
+        return write(path, tga_image());
+      return write(path, "");
+    }
+
+    int write(const string& path, string_view contents) {
+      fs::path p = fs::path(root) / path;
+      string dir = p.parent_path().string();
+      if (not dirs.contains(dir)) {
+        error_code ec;
+        fs::create_directories(dir, ec);
+        if (ec) {
+          errno = ec.value();
+          return -1;
+        }
+        dirs.insert(dir);
+      }
+      ofstream f(p, ios::binary);
+      if (not f or not f.write(contents.data(), contents.size()))
+        return -1;
+      return 0;
+    }
+
+  private:
+    string root;
+    const corpus_spec& spec;
+    mt19937_64 rng;
+    uniform_real_distribution<double> coin{0.0, 1.0};
+    unordered_set<string> dirs;
+  };
+
+  string faction(size_t i) { return fmt::format("faction{}", i); }
+} // namespace
+
+int write_corpus(string_view dir, const corpus_spec& spec) {
+  corpus_writer w(dir, spec);
+  string edu, eu, en = "{\n", dmb, dms, dc, db;
+
+  for (size_t i = 0; i < spec.units; ++i) {
+    string name = fmt::format("unit{}", i);
+    bool mercenary = i % 10 == 9;
+    vector<string> owners;
+    string ownership;
+    if (mercenary or spec.factions == 0)
+      owners.push_back("slave");
+    else {
+      owners.push_back(faction(i % spec.factions));
+      if (size_t f = (i * 7 + 3) % spec.factions; f != i % spec.factions)
+        owners.push_back(faction(f));
+      if (i % 5 == 0)
+        owners.push_back("slave");
+    }
+    edu += fmt::format("type             {}\n", name);
+    edu += fmt::format("dictionary       {}\n", name);
+    if (spec.battle_models != 0) {
+      edu += fmt::format("soldier          bm{}, 40, 0, 1\n",
+                         i % spec.battle_models);
+      if (i % 4 == 0)
+        edu += fmt::format("officer          bm{}\n",
+                           (i + 1) % spec.battle_models);
+    }
+    edu += fmt::format("attributes       sea_faring, hide_forest{}\n",
+                       mercenary ? ", mercenary_unit" : "");
+    for (const auto& owner : owners)
+      ownership += fmt::format("{}{}", ownership.empty() ? "" : ", ", owner);
+    edu += fmt::format("ownership        {}\n\n", ownership);
+
+    if (mercenary) {
+      if (w.touch(fmt::format("data/ui/units/mercs/#{}.tga", name)) == -1 or
+          w.touch(fmt::format("data/ui/unit_info/merc/{}_info.tga", name)) ==
+            -1)
+        return -1;
+    }
+    else {
+      for (const auto& owner : owners) {
+        if (w.touch(fmt::format("data/ui/units/{}/#{}.tga", owner, name)) ==
+              -1 or
+            w.touch(fmt::format("data/ui/unit_info/{}/{}_info.tga", owner,
+                                name)) == -1)
+          return -1;
+      }
+    }
+    for (string_view suffix : {"", "_descr", "_descr_short"}) {
+      if (w.present())
+        eu += fmt::format("\n\n{{{}{}}}{}{}", name, suffix, name, suffix);
+      if (w.present())
+        en += fmt::format("\"Rome.Override.{}{}\": \"{}{}\",\n", name, suffix,
+                          name, suffix);
+    }
+  }
+  en += "}\n";
+
+  for (size_t i = 0; i < spec.battle_models; ++i) {
+    string name = fmt::format("bm{}", i);
+    string tex = fmt::format("data/models_unit/textures/{}", name);
+    string model = fmt::format("data/models_unit/{}", name);
+    dmb += fmt::format("type {}\nskeleton fs_spearman\n", name);
+    if (spec.factions != 0) {
+      string owner = faction(i % spec.factions);
+      dmb += fmt::format("texture {}, {}_{}.tga\n", owner, tex, owner);
+      if (w.touch(fmt::format("{}_{}.tga.dds", tex, owner)) == -1)
+        return -1;
+    }
+    dmb += fmt::format("texture {}.tga\n", tex);
+    dmb += fmt::format("pbr_texture {}_pbr.tga\n", tex);
+    dmb += fmt::format("model_flexi {}.cas, 15\n", model);
+    dmb += fmt::format("model_flexi {}_lod.cas, max\n\n", model);
+    vector<string> cas_textures = {fmt::format("{}.tga", name),
+                                   fmt::format("{}_pbr.tga", name)};
+    string cas = cas_model_file("fs_spearman", cas_textures);
+    if (w.touch(fmt::format("{}.tga.dds", tex)) == -1 or
+        w.touch(fmt::format("{}_pbr.tga.dds", tex)) == -1 or
+        w.touch(fmt::format("{}.cas", model), cas) == -1 or
+        w.touch(fmt::format("{}_lod.cas", model), cas) == -1)
+      return -1;
+  }
+
+  for (size_t i = 0; i < spec.strat_models; ++i) {
+    string name = fmt::format("sm{}", i);
+    string tex = fmt::format("data/models_strat/textures/{}", name);
+    string model = fmt::format("data/models_strat/{}", name);
+    dms += fmt::format("type {}\n", name);
+    dms += fmt::format("model_flexi {}.cas\n", model);
+    dms += fmt::format("no_variation model_flexi {}_nv.cas\n", model);
+    dms += fmt::format("texture {}.tga\n", tex);
+    dms += fmt::format("pbr_texture {}_pbr.tga\n", tex);
+    if (spec.factions != 0) {
+      string owner = faction(i % spec.factions);
+      dms += fmt::format("texture {}, {}_{}.tga\n", owner, tex, owner);
+      dms += fmt::format("pbr_texture {}, {}_{}_pbr.tga\n", owner, tex, owner);
+      if (w.touch(fmt::format("{}_{}.tga.dds", tex, owner)) == -1 or
+          w.touch(fmt::format("{}_{}_pbr.tga.dds", tex, owner)) == -1)
+        return -1;
+    }
+    dms += "\n";
+    vector<string> cas_textures = {fmt::format("{}.tga", name),
+                                   fmt::format("{}_pbr.tga", name)};
+    string cas = cas_model_file("strat_general", cas_textures);
+    if (w.touch(fmt::format("{}.tga.dds", tex)) == -1 or
+        w.touch(fmt::format("{}_pbr.tga.dds", tex)) == -1 or
+        w.touch(fmt::format("{}.cas", model), cas) == -1 or
+        w.touch(fmt::format("{}_nv.cas", model), cas) == -1)
+      return -1;
+
+    // Characters use the strat models of their neighbours too, so that
+    // shared models are handled.
+    dc += fmt::format("type character{}\n", i);
+    if (spec.factions != 0)
+      dc += fmt::format("faction {}\nstrat_model {}\n",
+                        faction(i % spec.factions), name);
+    dc += fmt::format("faction slave\nstrat_model sm{}\n\n",
+                      (i + 1) % spec.strat_models);
+  }
+
+  for (size_t i = 0; i < spec.banners; ++i) {
+    db += fmt::format("banner b{}\n", i);
+    db += fmt::format("standard_texture banners/b{}\n", i);
+    db += fmt::format("rebels_texture banners/b{}_rebels\n\n", i);
+    if (w.touch(fmt::format("data/banners/b{}.dds", i)) == -1 or
+        w.touch(fmt::format("data/banners/b{}_rebels.dds", i)) == -1)
+      return -1;
+  }
+
+  // Units are recruited in as many levels of one building as there are
+  // factions, by the factions owning them, after everything else so that the
+  // rest of the corpus stays the same for a given seed.
+  string dsf, edb = "building barracks\n{\n    levels";
+  for (size_t f = 0; f < spec.factions; ++f) {
+    dsf += fmt::format("faction {}\nculture roman\n\n", faction(f));
+    edb += fmt::format(" barracks{}", f);
+  }
+  dsf += "faction slave\nculture barbarian\n";
+  edb += "\n    {\n";
+  for (size_t f = 0; f < spec.factions; ++f) {
+    edb += fmt::format("        barracks{} requires factions {{ {}, }}\n"
+                       "        {{\n            capability\n            {{\n",
+                       f, faction(f));
+    for (size_t i = f; i < spec.units; i += spec.factions)
+      if (i % 10 != 9 and w.present())
+        edb += fmt::format("                recruit \"unit{}\" 0 requires "
+                           "factions {{ {}, }}\n",
+                           i, faction(f));
+    edb += "            }\n        }\n";
+  }
+  edb += "    }\n}\n";
+
+  string eu_utf16 = "\xff\xfe";
+  utf8_to_utf16le("\xc2\xac Generated corpus.\n" + eu, eu_utf16);
+  if (w.write("data/export_descr_unit.txt", edu) == -1 or
+      w.write("data/text/export_units.txt", eu_utf16) == -1 or
+      w.write("data/string_overrides/en.strings", en) == -1 or
+      w.write("data/descr_model_battle.txt", dmb) == -1 or
+      w.write("data/descr_model_strat.txt", dms) == -1 or
+      w.write("data/descr_character.txt", dc) == -1 or
+      w.write("data/descr_banners.txt", db) == -1 or
+      w.write("data/descr_sm_factions.txt", dsf) == -1 or
+      w.write("data/export_descr_buildings.txt", edb) == -1 or
+      w.write("data/descr_skeleton.txt",
+              "type fs_spearman\n\ntype strat_general\n") == -1)
+    return -1;
+  return 0;
+}
@@ -0,0 +1,34 @@
+#ifndef RRT_CORPUS_HPP
+#define RRT_CORPUS_HPP
+
+#include <cstdint>
+#include <string_view>
+
+// Shape of a synthetic mod, see write_corpus().
+struct corpus_spec {
+  size_t units = 500;
+  size_t factions = 16;
+  size_t battle_models = 400;
+  size_t strat_models = 100;
+  size_t banners = 50;
+
+  // Fraction of the referenced asset files and text tags that are left out,
+  // so that verification has problems to report.
+  double missing = 0.05;
+  uint64_t seed = 1;
+
+  // Multiplies every count but the factions.
+  corpus_spec scaled(size_t factor) const;
+};
+
+// Writes a mod below `dir`: the definition files the verificator reads, and
+// files for everything they reference, less the missing ones. Textures and
+// unit cards are tiny valid images, and models name their skeleton (declared
+// in descr_skeleton.txt) and textures. Every unit gets a battle model of its
+// own as long as there are enough, and one descr_character.txt entry is
+// written per strat model. Units that aren't mercenaries are recruited in
+// export_descr_buildings.txt, less the missing ones. Returns -1 on failure,
+// with errno set.
+int write_corpus(std::string_view dir, const corpus_spec& spec);
+
+#endif
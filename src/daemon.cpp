@@ -0,0 +1,281 @@
+#include "daemon.hpp"
+
+#include <algorithm>
+#include <cerrno>
+#include <chrono>
+#include <dcc/errno.hpp>
+#include <dcc/logger.hpp>
+#include <unordered_set>
+
+#include "asset_index.hpp"
+#include "local_socket.hpp"
+#include "profiler.hpp"
+
+#ifndef _WIN32
+#include <poll.h>
+#include <unistd.h>
+#endif
+
+using namespace std;
+using namespace dcc;
+
+void resident_mod::load_all() {
+  g::verify_all = true;
+  load(st, definition_files());
+  link();
+  check();
+}
+
+void resident_mod::update(const vector<file_watcher::event>& events) {
+  if (events.empty())
+    return;
+  vector<string_view> reload = apply_changes(events);
+
+  // With the definitions as they were, only files whose existence some
+  // result depended on can change any.
+  if (reload.empty() and
+      none_of(events.begin(), events.end(), [](const auto& e) {
+        return probed(e.path, e.directory);
+      }))
+    return;
+  if (not reload.empty()) {
+    load(st, reload);
+    link();
+  }
+  check();
+}
+
+void resident_mod::link() {
+  profiler::span span("link");
+  units.clear();
+  characters.clear();
+  banners.clear();
+  for (size_t i = 0; i < st.units.size(); ++i)
+    units.try_emplace(st.units[i].dictionary, i);
+  for (size_t i = 0; i < st.strat_model_entries.size(); ++i)
+    characters.try_emplace(st.strat_model_entries[i].type, i);
+  for (size_t i = 0; i < st.banners.size(); ++i)
+    banners.try_emplace(st.banners[i].type, i);
+  rosters = rosters_of(st);
+  graph.build(st);
+}
+
+// Entries are listed in the order of verify(), so that file requests list
+// them the same way. What didn't change comes from the verification caches.
+void resident_mod::check() {
+  profiler::span span("check");
+  results.clear();
+  results.reserve(st.units.size() + st.strat_model_entries.size() +
+                  st.banners.size());
+  auto problems = check_units(st, rosters);
+  for (size_t i = 0; i < st.units.size(); ++i)
+    results.push_back({st.units[i].dictionary, g::edu_filename,
+                       st.units[i].lineno, move(problems[i])});
+  problems = check_characters(st);
+  for (size_t i = 0; i < st.strat_model_entries.size(); ++i)
+    results.push_back({st.strat_model_entries[i].type, g::dc_filename,
+                       st.strat_model_entries[i].lineno, move(problems[i])});
+  problems = check_banners(st);
+  for (size_t i = 0; i < st.banners.size(); ++i)
+    results.push_back({st.banners[i].type, g::db_filename,
+                       st.banners[i].lineno, move(problems[i])});
+}
+
+string resident_mod::render(const report& r, string_view what) const {
+  string out = r.render(g::problems_format);
+  if (out.empty() and g::problems_format == report_format::human)
+    out = fmt::format("No problems with {}.\n", sgr::unique(what));
+  return out;
+}
+
+string resident_mod::answer(string_view request, bool& ok) {
+  profiler::span span("answer");
+  size_t space = request.find(' ');
+  string_view command = request.substr(0, space);
+  string_view arg;
+  if (space != string_view::npos) {
+    arg = request.substr(space + 1);
+    arg.remove_prefix(min(arg.find_first_not_of(" \t"), arg.size()));
+  }
+  ok = true;
+  auto nowhere = [&ok](string_view what, string_view name) {
+    ok = false;
+    return fmt::format("No {} called {} is defined.\n", what,
+                       sgr::problem(name));
+  };
+  report r;
+  auto found = [&](size_t i) {
+    const verified& v = results[i];
+    r.add(v.name, v.fname, v.lineno, v.problems);
+    return render(r, v.name);
+  };
+  size_t nunits = st.units.size();
+  size_t ncharacters = st.strat_model_entries.size();
+
+  if (command == "unit") {
+    auto it = units.find(arg);
+    if (it == units.end())
+      return nowhere("unit", arg);
+    return found(it->second);
+  }
+  if (command == "battle_model") {
+    auto it = st.battle_models.find(string(arg));
+    if (it == st.battle_models.end())
+      return nowhere("battle model", arg);
+    const battle_model& bm = it->second;
+
+    // Battle models are only ever checked for the units using them, so what
+    // those have at the lines of the model is theirs.
+    unordered_set<size_t> lines = {bm.lineno};
+    for (const auto* textures : {&bm.textures, &bm.pbr_textures})
+      for (const auto& [owner, t] : *textures)
+        lines.insert(t.lineno);
+    vector<problem> problems;
+    for (auto id : graph.find(arg)) {
+      if (graph.at(id).kind != node_kind::battle_model)
+        continue;
+      for (auto user : graph.users(id)) {
+        auto u = units.find(graph.at(user).name);
+        if (u == units.end())
+          continue;
+        for (const auto& p : results[u->second].problems)
+          if (p.file == g::dmb_filename and lines.contains(p.lineno) and
+              find(problems.begin(), problems.end(), p) == problems.end())
+            problems.push_back(p);
+      }
+    }
+    r.add(bm.dictionary, g::dmb_filename, bm.lineno, move(problems));
+    return render(r, bm.dictionary);
+  }
+  if (command == "character") {
+    auto it = characters.find(arg);
+    if (it == characters.end())
+      return nowhere("character", arg);
+    return found(nunits + it->second);
+  }
+  if (command == "banner") {
+    auto it = banners.find(arg);
+    if (it == banners.end())
+      return nowhere("banner", arg);
+    return found(nunits + ncharacters + it->second);
+  }
+  if (command == "file") {
+    string n = asset_index::normalize(arg);
+    for (const auto& v : results) {
+      if (asset_index::normalize(v.fname) == n) {
+        r.add(v.name, v.fname, v.lineno, v.problems);
+        continue;
+      }
+      vector<problem> problems;
+      for (const auto& p : v.problems)
+        if (asset_index::normalize(p.file) == n or
+            asset_index::normalize(p.path) == n)
+          problems.push_back(p);
+      r.add(v.name, v.fname, v.lineno, move(problems));
+    }
+    return render(r, arg);
+  }
+  if (command == "query")
+    return answer_query(graph, arg);
+  if (command == "reload") {
+    auto start = chrono::steady_clock::now();
+    g::assets.build("data");
+    load_all();
+    chrono::duration<double, milli> took = chrono::steady_clock::now() - start;
+    return fmt::format("Reloaded in {:.1f} ms.\n", took.count());
+  }
+  ok = false;
+  return fmt::format("Unknown request {}.\n", sgr::problem(request));
+}
+
+#ifndef _WIN32
+
+int serve(string_view socket_path) {
+  resident_mod mod;
+  mod.load_all();
+  file_watcher watcher;
+  if (watcher.watch_tree("data") == -1)
+    dcc_loginf("Could not watch {} ({}), changes need a reload request.",
+               sgr::file("data"), errmsg());
+  int listener = listen_local(socket_path);
+  if (listener == -1)
+    return -1;
+  dcc_logmsg("Listening at {}...", sgr::file(socket_path));
+
+  struct client {
+    int fd;
+    string buf;
+  };
+  vector<client> clients;
+  bool stop = false;
+  while (not stop) {
+    vector<pollfd> fds = {{listener, POLLIN, 0},
+                          {watcher.descriptor(), POLLIN, 0}};
+    for (const auto& c : clients)
+      fds.push_back({c.fd, POLLIN, 0});
+    if (poll(fds.data(), fds.size(), -1) == -1) {
+      if (errno == EINTR)
+        continue;
+      break;
+    }
+    if (fds[1].revents & POLLIN) {
+      auto start = chrono::steady_clock::now();
+      mod.update(watcher.wait(chrono::milliseconds(50)));
+      chrono::duration<double, milli> took =
+        chrono::steady_clock::now() - start;
+      dcc_loginf("Caught up with changes in {:.1f} ms.", took.count());
+    }
+
+    // Requests are answered in the order they came in on each connection.
+    for (size_t i = 0; i < clients.size(); ++i) {
+      if (fds[i + 2].revents == 0)
+        continue;
+      client& c = clients[i];
+      bool done = receive(c.fd, c.buf) != 1;
+      for (size_t end; not done and (end = c.buf.find('\n')) != string::npos;) {
+        string request = c.buf.substr(0, end);
+        c.buf.erase(0, end + 1);
+        if (request.ends_with('\r'))
+          request.pop_back();
+        auto start = chrono::steady_clock::now();
+        bool ok = true;
+        string answer;
+        if (request == "stop")
+          stop = true;
+        else
+          answer = mod.answer(request, ok);
+        string reply = fmt::format("{} {}\n{}", ok ? "ok" : "error",
+                                   answer.size(), answer);
+        done = send_all(c.fd, reply) == -1;
+        chrono::duration<double, milli> took =
+          chrono::steady_clock::now() - start;
+        dcc_loginf("Answered {} in {:.3f} ms.", sgr::unique(request),
+                   took.count());
+      }
+      if (done) {
+        close_local(c.fd);
+        c.fd = -1;
+      }
+    }
+    erase_if(clients, [](const client& c) { return c.fd == -1; });
+    if (fds[0].revents & POLLIN) {
+      int fd = accept_local(listener);
+      if (fd != -1)
+        clients.push_back({fd, ""});
+    }
+  }
+  for (const auto& c : clients)
+    close_local(c.fd);
+  close_local(listener);
+  unlink(string(socket_path).c_str());
+  return stop ? 0 : -1;
+}
+
+#else
+
+int serve(string_view) {
+  errno = ENOSYS;
+  return -1;
+}
+
+#endif
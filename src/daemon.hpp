@@ -0,0 +1,73 @@
+#ifndef RRT_DAEMON_HPP
+#define RRT_DAEMON_HPP
+
+#include <string>
+#include <string_view>
+#include <unordered_map>
+#include <vector>
+
+#include "dependency_graph.hpp"
+#include "file_watcher.hpp"
+#include "report.hpp"
+#include "verification.hpp"
+
+// A mod kept parsed, linked and verified between requests, for the daemon.
+// Requests are a command and its argument, on one line:
+//
+//   unit NAME          the problems of a unit
+//   battle_model NAME  the problems of a descr_model_battle.txt entry, as
+//                      found through the units that use it
+//   character NAME     the problems of a descr_character.txt entry
+//   banner NAME        the problems of a banner
+//   file PATH          the problems of what is defined in the file at PATH,
+//                      or points at it
+//   query NAME         what depends on NAME, as with --query
+//   reload             parses and verifies everything again
+//
+// Problems are rendered as g::problems_format says.
+class resident_mod {
+public:
+  // Parses, links and verifies every definition file.
+  void load_all();
+
+  // Brings everything up to date with `events`, parsing again only the
+  // definition files they changed, and checking again only the entries that
+  // changed or whose files did.
+  void update(const std::vector<file_watcher::event>& events);
+
+  // The answer to `request`, setting `ok` to whether there was one.
+  std::string answer(std::string_view request, bool& ok);
+
+private:
+  struct verified {
+    std::string_view name;
+    std::string_view fname;
+    size_t lineno;
+    std::vector<problem> problems;
+  };
+
+  void link();
+  void check();
+  std::string render(const report& r, std::string_view what) const;
+
+  mod_state st;
+  unit_rosters rosters;
+  dependency_graph graph;
+
+  // Indices of entries by name, the first of each name.
+  std::unordered_map<std::string_view, size_t> units;
+  std::unordered_map<std::string_view, size_t> characters;
+  std::unordered_map<std::string_view, size_t> banners;
+
+  // Every entry with its problems, from the last time anything changed: the
+  // units, then the characters, then the banners, as in `st`.
+  std::vector<verified> results;
+};
+
+// Answers requests for the mod in the current directory at the socket
+// `socket_path`, one line per request, each answer being a line of "ok" or
+// "error" and its length in bytes, then the answer itself. Keeps at it until
+// asked to "stop". Returns -1 on failure, with errno set.
+int serve(std::string_view socket_path);
+
+#endif
@@ -0,0 +1,163 @@
+#include "dependency_graph.hpp"
+
+#include <algorithm>
+#include <dcc/logger.hpp>
+
+#include "asset_index.hpp"
+#include "verification.hpp"
+
+using namespace std;
+
+string_view kind_name(node_kind kind) {
+  switch (kind) {
+  case node_kind::unit:
+    return "unit";
+  case node_kind::battle_model:
+    return "battle model";
+  case node_kind::character:
+    return "character";
+  case node_kind::strat_model:
+    return "strat model";
+  case node_kind::banner:
+    return "banner";
+  default:
+    return "file";
+  }
+}
+
+dependency_graph::node_id dependency_graph::intern(node_kind kind,
+                                                   string_view name,
+                                                   string_view fname,
+                                                   size_t lineno) {
+  string key = kind == node_kind::file ? asset_index::normalize(name)
+                                       : string(name);
+  auto [it, added] =
+    ids.try_emplace(fmt::format("{}:{}", int(kind), key), node_id(0));
+  if (added) {
+    it->second = node_id(nodes.size());
+    nodes.push_back({kind, string(name), "", 0});
+    by_name[key].push_back(it->second);
+  }
+  node& n = nodes[it->second];
+  if (not fname.empty() and n.fname.empty()) {
+    n.fname = fname;
+    n.lineno = lineno;
+  }
+  return it->second;
+}
+
+void dependency_graph::build(const mod_state& st) {
+  nodes.clear();
+  ids.clear();
+  by_name.clear();
+  edges.clear();
+
+  auto link_textures = [this](node_id from, const auto& textures) {
+    for (const auto& [owner, t] : textures)
+      link(from, intern(node_kind::file, fmt::format("{}.dds", t.path)));
+  };
+  for (const auto& [name, bm] : st.battle_models) {
+    node_id id =
+      intern(node_kind::battle_model, name, g::dmb_filename, bm.lineno);
+    link_textures(id, bm.textures);
+    link_textures(id, bm.pbr_textures);
+    for (const auto& path : bm.model_paths)
+      link(id, intern(node_kind::file, path));
+  }
+  for (const auto& u : st.units) {
+    node_id id = intern(node_kind::unit, u.dictionary, g::edu_filename,
+                        u.lineno);
+    for (const auto* troops : {&u.soldiers, &u.officers})
+      for (const auto& soldier : *troops)
+        link(id, intern(node_kind::battle_model, soldier));
+    auto card = [this, id](string path) {
+      link(id, intern(node_kind::file, path));
+    };
+    if (u.mercenary) {
+      card(fmt::format("data/ui/units/mercs/#{}.tga", u.dictionary));
+      card(fmt::format("data/ui/unit_info/merc/{}_info.tga", u.dictionary));
+      continue;
+    }
+    for (atom owner_id : u.owners) {
+      string_view owner = atoms.name(owner_id);
+      card(fmt::format("data/ui/units/{}/#{}.tga", owner, u.dictionary));
+      card(fmt::format("data/ui/unit_info/{}/{}_info.tga", owner,
+                       u.dictionary));
+    }
+  }
+  for (const auto& [name, sm] : st.strat_models) {
+    node_id id =
+      intern(node_kind::strat_model, name, g::dms_filename, sm.lineno);
+    link_textures(id, sm.textures);
+    link_textures(id, sm.pbr_textures);
+    for (const pmr::string* path : {&sm.path, &sm.nv_path})
+      if (not path->empty())
+        link(id, intern(node_kind::file, *path));
+  }
+  for (const auto& entry : st.strat_model_entries) {
+    node_id id = intern(node_kind::character, entry.type, g::dc_filename,
+                        entry.lineno);
+    for (const auto& [owner, modelstr] : entry.models)
+      link(id, intern(node_kind::strat_model, modelstr));
+  }
+  for (const auto& ban : st.banners) {
+    node_id id = intern(node_kind::banner, ban.type, g::db_filename,
+                        ban.lineno);
+    for (const auto& path : ban.texture_paths)
+      link(id, intern(node_kind::file, path));
+  }
+  finish();
+}
+
+void dependency_graph::finish() {
+  sort(edges.begin(), edges.end());
+  edges.erase(unique(edges.begin(), edges.end()), edges.end());
+
+  // Counts first, then every list is filled in place.
+  auto lay_out = [this](vector<uint32_t>& offsets, vector<node_id>& targets,
+                        bool reversed) {
+    offsets.assign(nodes.size() + 1, 0);
+    for (const auto& [from, to] : edges)
+      ++offsets[(reversed ? to : from) + 1];
+    for (size_t i = 1; i < offsets.size(); ++i)
+      offsets[i] += offsets[i - 1];
+    targets.resize(edges.size());
+    vector<uint32_t> next(offsets.begin(), offsets.end() - 1);
+    for (const auto& [from, to] : edges) {
+      if (reversed)
+        targets[next[to]++] = from;
+      else
+        targets[next[from]++] = to;
+    }
+  };
+  lay_out(forward_offsets, forward, false);
+  lay_out(reverse_offsets, reverse, true);
+  edges.clear();
+  edges.shrink_to_fit();
+}
+
+vector<dependency_graph::node_id>
+dependency_graph::find(string_view name) const {
+  vector<node_id> found;
+  for (const string& key : {string(name), asset_index::normalize(name)}) {
+    auto it = by_name.find(key);
+    if (it == by_name.end())
+      continue;
+    for (node_id id : it->second)
+      if (std::find(found.begin(), found.end(), id) == found.end())
+        found.push_back(id);
+  }
+  return found;
+}
+
+span<const dependency_graph::node_id>
+dependency_graph::uses(node_id id) const {
+  return {forward.data() + forward_offsets[id],
+          forward.data() + forward_offsets[id + 1]};
+}
+
+span<const dependency_graph::node_id>
+dependency_graph::users(node_id id) const {
+  return {reverse.data() + reverse_offsets[id],
+          reverse.data() + reverse_offsets[id + 1]};
+}
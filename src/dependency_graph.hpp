@@ -0,0 +1,74 @@
+#ifndef RRT_DEPENDENCY_GRAPH_HPP
+#define RRT_DEPENDENCY_GRAPH_HPP
+
+#include <cstdint>
+#include <span>
+#include <string>
+#include <string_view>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+
+struct mod_state;
+
+enum class node_kind : uint8_t {
+  unit,
+  battle_model,
+  character,
+  strat_model,
+  banner,
+  file
+};
+
+std::string_view kind_name(node_kind kind);
+
+// What uses what across export_descr_unit.txt, descr_model_battle.txt,
+// descr_character.txt, descr_model_strat.txt and descr_banners.txt, down to
+// the files they reference. Edges are kept both ways as flat adjacency
+// lists, so that "who uses this?" is a lookup rather than a rescan.
+class dependency_graph {
+public:
+  using node_id = uint32_t;
+
+  struct node {
+    node_kind kind;
+    std::string name;
+
+    // Where the node is defined, empty for files and for names referenced
+    // but defined nowhere.
+    std::string_view fname;
+    size_t lineno;
+  };
+
+  // Replaces the graph with the one of `st`.
+  void build(const mod_state& st);
+
+  // Nodes called `name`: entries of that name, or the file at that path.
+  std::vector<node_id> find(std::string_view name) const;
+
+  const node& at(node_id id) const { return nodes[id]; }
+  std::span<const node_id> uses(node_id id) const;
+  std::span<const node_id> users(node_id id) const;
+
+  size_t size() const { return nodes.size(); }
+  size_t edge_count() const { return forward.size(); }
+
+private:
+  node_id intern(node_kind kind, std::string_view name,
+                 std::string_view fname = "", size_t lineno = 0);
+  void link(node_id from, node_id to) { edges.emplace_back(from, to); }
+  void finish();
+
+  std::vector<node> nodes;
+  std::unordered_map<std::string, node_id> ids;
+  std::unordered_map<std::string, std::vector<node_id>> by_name;
+
+  // Collected while building, then laid out by finish().
+  std::vector<std::pair<node_id, node_id>> edges;
+  std::vector<uint32_t> forward_offsets;
+  std::vector<node_id> forward;
+  std::vector<uint32_t> reverse_offsets;
+  std::vector<node_id> reverse;
+};
+
+#endif
@@ -0,0 +1,244 @@
+#include "encoding.hpp"
+
+#include <cstdint>
+#include <cstring>
+
+#include "mapped_file.hpp"
+
+#if defined(__SSE2__) || defined(_M_X64)
+#include <emmintrin.h>
+#define RRT_SSE2 1
+#endif
+
+using namespace std;
+
+static constexpr char32_t replacement = 0xfffd;
+
+byte_order_mark detect_bom(string_view buf) {
+  if (buf.starts_with("\xef\xbb\xbf"))
+    return {text_encoding::utf8, 3};
+  if (buf.starts_with("\xff\xfe"))
+    return {text_encoding::utf16le, 2};
+  if (buf.starts_with("\xfe\xff"))
+    return {text_encoding::utf16be, 2};
+  return {text_encoding::none, 0};
+}
+
+// Converts the longest run of ASCII at the start of `in` (of `n` UTF-16LE
+// code units), returning how many code units it took.
+static size_t ascii_from_utf16le(const unsigned char* in, size_t n,
+                                 char* out) {
+  size_t i = 0;
+#ifdef RRT_SSE2
+  const __m128i non_ascii = _mm_set1_epi16(int16_t(0xff80));
+  const __m128i zero = _mm_setzero_si128();
+  for (; i + 8 <= n; i += 8) {
+    __m128i units = _mm_loadu_si128((const __m128i*)(in + i * 2));
+    __m128i high = _mm_and_si128(units, non_ascii);
+    if (_mm_movemask_epi8(_mm_cmpeq_epi16(high, zero)) != 0xffff)
+      break;
+    _mm_storel_epi64((__m128i*)(out + i), _mm_packus_epi16(units, units));
+  }
+#else
+  for (; i + 4 <= n; i += 4) {
+    uint64_t units;
+    memcpy(&units, in + i * 2, sizeof(units));
+    if (units & 0xff80ff80ff80ff80ull)
+      break;
+    for (size_t j = 0; j < 4; ++j)
+      out[i + j] = char(in[(i + j) * 2]);
+  }
+#endif
+  for (; i < n and in[i * 2 + 1] == 0 and in[i * 2] < 0x80; ++i)
+    out[i] = char(in[i * 2]);
+  return i;
+}
+
+// Same as above, the other way around.
+static size_t ascii_to_utf16le(const unsigned char* in, size_t n,
+                               char* out) {
+  size_t i = 0;
+#ifdef RRT_SSE2
+  const __m128i zero = _mm_setzero_si128();
+  for (; i + 16 <= n; i += 16) {
+    __m128i bytes = _mm_loadu_si128((const __m128i*)(in + i));
+    if (_mm_movemask_epi8(bytes) != 0)
+      break;
+    _mm_storeu_si128((__m128i*)(out + i * 2), _mm_unpacklo_epi8(bytes, zero));
+    _mm_storeu_si128((__m128i*)(out + i * 2 + 16),
+                     _mm_unpackhi_epi8(bytes, zero));
+  }
+#else
+  for (; i + 8 <= n; i += 8) {
+    uint64_t bytes;
+    memcpy(&bytes, in + i, sizeof(bytes));
+    if (bytes & 0x8080808080808080ull)
+      break;
+    for (size_t j = 0; j < 8; ++j) {
+      out[(i + j) * 2] = char(in[i + j]);
+      out[(i + j) * 2 + 1] = 0;
+    }
+  }
+#endif
+  for (; i < n and in[i] < 0x80; ++i) {
+    out[i * 2] = char(in[i]);
+    out[i * 2 + 1] = 0;
+  }
+  return i;
+}
+
+static char* put_utf8(char32_t c, char* out) {
+  if (c < 0x80)
+    *out++ = char(c);
+  else if (c < 0x800) {
+    *out++ = char(0xc0 | (c >> 6));
+    *out++ = char(0x80 | (c & 0x3f));
+  }
+  else if (c < 0x10000) {
+    *out++ = char(0xe0 | (c >> 12));
+    *out++ = char(0x80 | ((c >> 6) & 0x3f));
+    *out++ = char(0x80 | (c & 0x3f));
+  }
+  else {
+    *out++ = char(0xf0 | (c >> 18));
+    *out++ = char(0x80 | ((c >> 12) & 0x3f));
+    *out++ = char(0x80 | ((c >> 6) & 0x3f));
+    *out++ = char(0x80 | (c & 0x3f));
+  }
+  return out;
+}
+
+static char* put_utf16le(char32_t c, char* out) {
+  auto put = [&out](char32_t unit) {
+    *out++ = char(unit & 0xff);
+    *out++ = char(unit >> 8);
+  };
+  if (c < 0x10000)
+    put(c);
+  else {
+    c -= 0x10000;
+    put(0xd800 | (c >> 10));
+    put(0xdc00 | (c & 0x3ff));
+  }
+  return out;
+}
+
+void utf16le_to_utf8(string_view in, string& out) {
+  const unsigned char* p = (const unsigned char*)in.data();
+  size_t n = in.size() / 2;
+  size_t start = out.size();
+
+  // No code unit takes more than three bytes, and surrogate pairs take four
+  // for two.
+  out.resize(start + n * 3);
+  char* o = out.data() + start;
+  for (size_t i = 0; i < n;) {
+    size_t ascii = ascii_from_utf16le(p + i * 2, n - i, o);
+    i += ascii;
+    o += ascii;
+    if (i == n)
+      break;
+    char32_t c = p[i * 2] | (p[i * 2 + 1] << 8);
+    ++i;
+    if (c >= 0xd800 and c < 0xdc00 and i < n) {
+      char32_t low = p[i * 2] | (p[i * 2 + 1] << 8);
+      if (low >= 0xdc00 and low < 0xe000) {
+        c = 0x10000 + ((c - 0xd800) << 10) + (low - 0xdc00);
+        ++i;
+      }
+    }
+    if (c >= 0xd800 and c < 0xe000)
+      c = replacement;
+    o = put_utf8(c, o);
+  }
+  out.resize(o - out.data());
+}
+
+// Decodes the sequence at the start of `in` (of `n` bytes), setting `len` to
+// the bytes it took. Malformed sequences take one byte each.
+static char32_t decode_utf8(const unsigned char* in, size_t n, size_t& len) {
+  len = 1;
+  unsigned char b = in[0];
+  size_t need;
+  char32_t c, min;
+  if (b < 0x80)
+    return b;
+  if ((b & 0xe0) == 0xc0) {
+    need = 1;
+    c = b & 0x1f;
+    min = 0x80;
+  }
+  else if ((b & 0xf0) == 0xe0) {
+    need = 2;
+    c = b & 0x0f;
+    min = 0x800;
+  }
+  else if ((b & 0xf8) == 0xf0) {
+    need = 3;
+    c = b & 0x07;
+    min = 0x10000;
+  }
+  else
+    return replacement;
+  if (need >= n)
+    return replacement;
+  for (size_t i = 1; i <= need; ++i) {
+    if ((in[i] & 0xc0) != 0x80)
+      return replacement;
+    c = (c << 6) | (in[i] & 0x3f);
+  }
+  if (c < min or c > 0x10ffff or (c >= 0xd800 and c < 0xe000))
+    return replacement;
+  len = need + 1;
+  return c;
+}
+
+void utf8_to_utf16le(string_view in, string& out) {
+  const unsigned char* p = (const unsigned char*)in.data();
+  size_t n = in.size();
+  size_t start = out.size();
+
+  // No byte turns into more than one code unit, and four-byte sequences
+  // turn into two.
+  out.resize(start + n * 2);
+  char* o = out.data() + start;
+  for (size_t i = 0; i < n;) {
+    size_t ascii = ascii_to_utf16le(p + i, n - i, o);
+    i += ascii;
+    o += ascii * 2;
+    if (i == n)
+      break;
+    size_t len;
+    char32_t c = decode_utf8(p + i, n - i, len);
+    i += len;
+    o = put_utf16le(c, o);
+  }
+  out.resize(o - out.data());
+}
+
+int read_text(string_view path, string& utf8) {
+  mapped_file f;
+  if (f.open(path) == -1)
+    return -1;
+  string_view buf = f.view();
+  byte_order_mark bom = detect_bom(buf);
+  buf.remove_prefix(bom.size);
+  utf8.clear();
+  switch (bom.encoding) {
+  case text_encoding::utf16le:
+    utf16le_to_utf8(buf, utf8);
+    break;
+  case text_encoding::utf16be: {
+    string swapped(buf.size() & ~size_t(1), '\0');
+    for (size_t i = 0; i + 1 < buf.size(); i += 2) {
+      swapped[i] = buf[i + 1];
+      swapped[i + 1] = buf[i];
+    }
+    utf16le_to_utf8(swapped, utf8);
+    break;
+  }
+  default:
+    utf8 = buf;
+  }
+  return 0;
+}
@@ -0,0 +1,28 @@
+#ifndef RRT_ENCODING_HPP
+#define RRT_ENCODING_HPP
+
+#include <string>
+#include <string_view>
+
+// Encodings the game's text files come in, as told by their byte order mark.
+// Files without one are taken to be UTF-8 (or plain ASCII).
+enum class text_encoding { none, utf8, utf16le, utf16be };
+
+struct byte_order_mark {
+  text_encoding encoding;
+  size_t size;
+};
+
+byte_order_mark detect_bom(std::string_view buf);
+
+// Transcode between UTF-16LE (without a BOM) and UTF-8, appending to `out`.
+// Runs of ASCII are converted a block at a time. Anything that can't be
+// decoded becomes U+FFFD, and a trailing odd byte of UTF-16 is dropped.
+void utf16le_to_utf8(std::string_view in, std::string& out);
+void utf8_to_utf16le(std::string_view in, std::string& out);
+
+// Reads a text file in any of the encodings above into UTF-8, without its
+// BOM. Returns -1 on failure, with errno set.
+int read_text(std::string_view path, std::string& utf8);
+
+#endif
@@ -0,0 +1,116 @@
+#include "file_watcher.hpp"
+
+#include <cerrno>
+#include <filesystem>
+
+#ifdef __linux__
+#include <poll.h>
+#include <sys/inotify.h>
+#include <unistd.h>
+#endif
+
+using namespace std;
+namespace fs = std::filesystem;
+
+#ifdef __linux__
+
+file_watcher::~file_watcher() {
+  if (fd != -1)
+    close(fd);
+}
+
+int file_watcher::watch_tree(string_view dir) {
+  if (fd == -1 and (fd = inotify_init1(IN_CLOEXEC)) == -1)
+    return -1;
+  constexpr uint32_t mask = IN_CLOSE_WRITE | IN_CREATE | IN_DELETE |
+                            IN_MOVED_FROM | IN_MOVED_TO | IN_DELETE_SELF;
+  auto add = [this](const string& d) {
+    int wd = inotify_add_watch(fd, d.c_str(), mask);
+    if (wd == -1)
+      return -1;
+    dirs[wd] = d;
+    return 0;
+  };
+  if (add(string(dir)) == -1)
+    return -1;
+  error_code ec;
+  for (auto it = fs::recursive_directory_iterator(
+         dir, fs::directory_options::skip_permission_denied, ec);
+       it != fs::recursive_directory_iterator(); it.increment(ec)) {
+    if (ec)
+      break;
+    if (it->is_directory(ec) and add(it->path().generic_string()) == -1)
+      return -1;
+  }
+  return 0;
+}
+
+void file_watcher::read_events(vector<event>& events) {
+  alignas(inotify_event) char buf[64 * 1024];
+  ssize_t len = read(fd, buf, sizeof(buf));
+  for (char* p = buf; len > 0 and p < buf + len;) {
+    const inotify_event* e = reinterpret_cast<const inotify_event*>(p);
+    p += sizeof(inotify_event) + e->len;
+    if (e->mask & IN_Q_OVERFLOW) {
+      events.push_back({"", false, false});
+      continue;
+    }
+    if (e->mask & IN_IGNORED) {
+      dirs.erase(e->wd);
+      continue;
+    }
+    auto it = dirs.find(e->wd);
+    if (it == dirs.end() or e->len == 0)
+      continue;
+    string path = it->second + "/" + e->name;
+    bool removed = e->mask & (IN_DELETE | IN_MOVED_FROM);
+    bool directory = e->mask & IN_ISDIR;
+    events.push_back({path, removed, directory});
+
+    // Files in new directories may have been created before they could be
+    // watched, so they are reported here.
+    if (directory and not removed) {
+      watch_tree(path);
+      error_code ec;
+      for (auto d = fs::recursive_directory_iterator(path, ec);
+           d != fs::recursive_directory_iterator(); d.increment(ec)) {
+        if (ec)
+          break;
+        events.push_back(
+          {d->path().generic_string(), false, d->is_directory(ec)});
+      }
+    }
+  }
+}
+
+vector<file_watcher::event> file_watcher::wait(chrono::milliseconds settle) {
+  vector<event> events;
+  pollfd pfd = {fd, POLLIN, 0};
+  int timeout = -1;
+  for (;;) {
+    int n = poll(&pfd, 1, timeout);
+    if (n == -1 and errno == EINTR)
+      continue;
+    if (n <= 0)
+      return events;
+    read_events(events);
+    timeout = static_cast<int>(settle.count());
+  }
+}
+
+#else
+
+file_watcher::~file_watcher() {}
+
+int file_watcher::watch_tree(string_view) {
+  errno = ENOSYS;
+  return -1;
+}
+
+void file_watcher::read_events(vector<event>&) {}
+
+vector<file_watcher::event> file_watcher::wait(chrono::milliseconds) {
+  return {};
+}
+
+#endif
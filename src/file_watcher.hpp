@@ -0,0 +1,47 @@
+#ifndef RRT_FILE_WATCHER_HPP
+#define RRT_FILE_WATCHER_HPP
+
+#include <chrono>
+#include <string>
+#include <string_view>
+#include <unordered_map>
+#include <vector>
+
+// Reports changes to files below a directory tree. Only implemented on Linux
+// (inotify) for now.
+class file_watcher {
+public:
+  struct event {
+
+    // Empty if changes were lost and everything should be considered changed.
+    std::string path;
+    bool removed;
+    bool directory;
+  };
+
+  file_watcher() = default;
+  file_watcher(const file_watcher&) = delete;
+  file_watcher& operator=(const file_watcher&) = delete;
+  ~file_watcher();
+
+  // Watches `dir` and all of its subdirectories. Returns -1 on failure, with
+  // errno set.
+  int watch_tree(std::string_view dir);
+
+  // Blocks until something changes, then keeps collecting changes until none
+  // have come in for `settle`, so that a save touching several files is
+  // reported at once.
+  std::vector<event> wait(std::chrono::milliseconds settle);
+
+  // Becomes readable when something changed, for waiting on it along with
+  // other descriptors. -1 if nothing is watched.
+  int descriptor() const { return fd; }
+
+private:
+  void read_events(std::vector<event>& events);
+
+  int fd = -1;
+  std::unordered_map<int, std::string> dirs;
+};
+
+#endif
@@ -0,0 +1,65 @@
+#include <dcc/errno.hpp>
+#include <dcc/logger.hpp>
+#include <string>
+#include <string_view>
+
+#include "corpus.hpp"
+
+using namespace std;
+using namespace dcc;
+
+// Writes a synthetic mod to benchmark and try the verificator on:
+//
+//   generate_corpus <dir> [--scale N] [--units N] [--factions N]
+//                   [--battle-models N] [--strat-models N] [--banners N]
+//                   [--missing FRACTION] [--seed N]
+int main(int argc, char** argv) {
+  corpus_spec spec;
+  size_t scale = 1;
+  string dir;
+  for (int i = 1; i < argc; ++i) {
+    string s = argv[i];
+    auto value = [&]() -> string {
+      if (i + 1 == argc) {
+        dcc_logerr("{} needs a value.", s);
+        exit(-1);
+      }
+      return argv[++i];
+    };
+    if (s == "--scale")
+      scale = stoul(value());
+    else if (s == "--units")
+      spec.units = stoul(value());
+    else if (s == "--factions")
+      spec.factions = stoul(value());
+    else if (s == "--battle-models")
+      spec.battle_models = stoul(value());
+    else if (s == "--strat-models")
+      spec.strat_models = stoul(value());
+    else if (s == "--banners")
+      spec.banners = stoul(value());
+    else if (s == "--missing")
+      spec.missing = stod(value());
+    else if (s == "--seed")
+      spec.seed = stoull(value());
+    else
+      dir = s;
+  }
+  if (dir.empty()) {
+    dcc_logerr("No output directory given.");
+    exit(-1);
+  }
+
+  spec = spec.scaled(scale);
+  dcc_logmsg("Generating {} units, {} battle models, {} strat models and {} "
+             "banners for {} factions in {}...",
+             sgr::semiunique(spec.units), sgr::semiunique(spec.battle_models),
+             sgr::semiunique(spec.strat_models), sgr::semiunique(spec.banners),
+             sgr::semiunique(spec.factions), sgr::file(dir));
+  if (write_corpus(dir, spec) == -1) {
+    dcc_logerr("Could not write corpus to {}: {}.", sgr::file(dir), errmsg());
+    exit(-1);
+  }
+  dcc_logmsg("Finished generating {}.", sgr::file(dir));
+  return 0;
+}
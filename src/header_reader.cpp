@@ -0,0 +1,312 @@
+#include "header_reader.hpp"
+
+#include <algorithm>
+#include <cerrno>
+#include <filesystem>
+#include <fstream>
+#include <functional>
+#include <utility>
+
+#include "thread_pool.hpp"
+
+#if defined(__linux__) && __has_include(<linux/io_uring.h>)
+#include <linux/io_uring.h>
+#ifdef IORING_FEAT_FAST_POLL
+#define RRT_IO_URING 1
+#include <atomic>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+#endif
+#endif
+
+using namespace std;
+namespace fs = std::filesystem;
+
+static void read_header(header_read& r, size_t nbytes) {
+  error_code ec;
+  r.size = fs::file_size(r.path, ec);
+  if (ec) {
+    r.size = 0;
+    r.error = ec.default_error_condition().value();
+    return;
+  }
+  ifstream f(r.path, ios::binary);
+  if (not f) {
+    r.error = errno != 0 ? errno : EIO;
+    return;
+  }
+  r.bytes.resize(min<uint64_t>(nbytes, r.size));
+  f.read(r.bytes.data(), r.bytes.size());
+  r.bytes.resize(f.gcount());
+}
+
+static void read_headers_from(vector<header_read>& reads, size_t begin,
+                              size_t nbytes, thread_pool* pool) {
+  auto read = [&reads, begin, nbytes](size_t i) {
+    read_header(reads[begin + i], nbytes);
+  };
+  if (pool)
+    pool->parallel_for(reads.size() - begin, read);
+  else
+    for (size_t i = 0; i < reads.size() - begin; ++i)
+      read(i);
+}
+
+#ifdef RRT_IO_URING
+
+namespace {
+
+  // Just enough of io_uring for read_headers(), on top of the raw system
+  // calls, so that liburing isn't needed.
+  class uring {
+  public:
+    uring() = default;
+    uring(const uring&) = delete;
+    uring& operator=(const uring&) = delete;
+    ~uring();
+
+    // Sets up a ring of (at least) `entries` entries. Returns -1 on failure,
+    // with errno set.
+    int open(unsigned entries);
+
+    // How many entries can be queued before each run().
+    unsigned capacity() const { return sq_entries; }
+
+    // Queues an empty entry for the caller to fill in.
+    io_uring_sqe& push();
+
+    // Submits everything queued, and calls `fn` with every completion until
+    // all of it is done. Returns -1 if the ring fails for good, with errno
+    // set, once `fn` has had the completions it already holds.
+    int run(const function<void(const io_uring_cqe&)>& fn);
+
+  private:
+    int fd = -1;
+    void* sq_ring = MAP_FAILED;
+    void* cq_ring = MAP_FAILED;
+    void* sqe_array = MAP_FAILED;
+    size_t sq_ring_size = 0;
+    size_t cq_ring_size = 0;
+    size_t sqe_array_size = 0;
+    unsigned sq_entries = 0;
+    unsigned* sq_tail = nullptr;
+    unsigned* sq_mask = nullptr;
+    unsigned* sq_array = nullptr;
+    unsigned* cq_head = nullptr;
+    unsigned* cq_tail = nullptr;
+    unsigned* cq_mask = nullptr;
+    io_uring_cqe* cqes = nullptr;
+    io_uring_sqe* sqes = nullptr;
+    unsigned tail = 0;
+    unsigned queued = 0;
+  };
+
+  uring::~uring() {
+    if (sqe_array != MAP_FAILED)
+      munmap(sqe_array, sqe_array_size);
+    if (cq_ring != MAP_FAILED and cq_ring != sq_ring)
+      munmap(cq_ring, cq_ring_size);
+    if (sq_ring != MAP_FAILED)
+      munmap(sq_ring, sq_ring_size);
+    if (fd != -1)
+      ::close(fd);
+  }
+
+  int uring::open(unsigned entries) {
+    io_uring_params p = {};
+    fd = int(syscall(__NR_io_uring_setup, entries, &p));
+    if (fd == -1)
+      return -1;
+
+    // Reads and stats as operations of their own came with 5.6, a release
+    // before this feature flag.
+    if (not (p.features & IORING_FEAT_FAST_POLL)) {
+      errno = ENOSYS;
+      return -1;
+    }
+    sq_ring_size = p.sq_off.array + p.sq_entries * sizeof(unsigned);
+    cq_ring_size = p.cq_off.cqes + p.cq_entries * sizeof(io_uring_cqe);
+    if (p.features & IORING_FEAT_SINGLE_MMAP)
+      sq_ring_size = cq_ring_size = max(sq_ring_size, cq_ring_size);
+    sq_ring = mmap(nullptr, sq_ring_size, PROT_READ | PROT_WRITE,
+                   MAP_SHARED | MAP_POPULATE, fd, IORING_OFF_SQ_RING);
+    if (sq_ring == MAP_FAILED)
+      return -1;
+    if (p.features & IORING_FEAT_SINGLE_MMAP)
+      cq_ring = sq_ring;
+    else {
+      cq_ring = mmap(nullptr, cq_ring_size, PROT_READ | PROT_WRITE,
+                     MAP_SHARED | MAP_POPULATE, fd, IORING_OFF_CQ_RING);
+      if (cq_ring == MAP_FAILED)
+        return -1;
+    }
+    sqe_array_size = p.sq_entries * sizeof(io_uring_sqe);
+    sqe_array = mmap(nullptr, sqe_array_size, PROT_READ | PROT_WRITE,
+                     MAP_SHARED | MAP_POPULATE, fd, IORING_OFF_SQES);
+    if (sqe_array == MAP_FAILED)
+      return -1;
+
+    char* sq = (char*)sq_ring;
+    char* cq = (char*)cq_ring;
+    sq_entries = p.sq_entries;
+    sq_tail = (unsigned*)(sq + p.sq_off.tail);
+    sq_mask = (unsigned*)(sq + p.sq_off.ring_mask);
+    sq_array = (unsigned*)(sq + p.sq_off.array);
+    cq_head = (unsigned*)(cq + p.cq_off.head);
+    cq_tail = (unsigned*)(cq + p.cq_off.tail);
+    cq_mask = (unsigned*)(cq + p.cq_off.ring_mask);
+    cqes = (io_uring_cqe*)(cq + p.cq_off.cqes);
+    sqes = (io_uring_sqe*)sqe_array;
+    tail = *sq_tail;
+    return 0;
+  }
+
+  io_uring_sqe& uring::push() {
+    unsigned i = tail++ & *sq_mask;
+    ++queued;
+    sq_array[i] = i;
+    sqes[i] = {};
+    return sqes[i];
+  }
+
+  int uring::run(const function<void(const io_uring_cqe&)>& fn) {
+    atomic_ref<unsigned>(*sq_tail).store(tail, memory_order_release);
+    unsigned unsubmitted = exchange(queued, 0);
+    unsigned pending = unsubmitted;
+    while (pending > 0) {
+      long n = syscall(__NR_io_uring_enter, fd, unsubmitted, pending,
+                       IORING_ENTER_GETEVENTS, nullptr, 0);
+      int error = n == -1 ? errno : 0;
+      if (n != -1)
+        unsubmitted -= unsigned(n);
+      unsigned head = *cq_head;
+      unsigned end = atomic_ref<unsigned>(*cq_tail).load(memory_order_acquire);
+      for (; head != end; ++head, --pending)
+        fn(cqes[head & *cq_mask]);
+      atomic_ref<unsigned>(*cq_head).store(head, memory_order_release);
+
+      // Only a full ring or a signal is worth another try.
+      if (error != 0 and error != EINTR and error != EAGAIN and
+          error != EBUSY) {
+        errno = error;
+        return -1;
+      }
+    }
+    return 0;
+  }
+
+} // namespace
+
+// Reads the headers in batches of half a ring: the opens and stats of a
+// batch go in at once, then its reads, each hard-linked to the close of its
+// file. Returns how many of `reads` were done, or -1 if io_uring isn't
+// available.
+static int64_t read_headers_uring(vector<header_read>& reads, size_t nbytes) {
+  uring ring;
+  if (ring.open(256) == -1)
+    return -1;
+  size_t batch = ring.capacity() / 2;
+  vector<int> fds(batch);
+  vector<struct statx> stats(batch);
+  for (size_t begin = 0; begin < reads.size(); begin += batch) {
+    size_t n = min(batch, reads.size() - begin);
+    fill(fds.begin(), fds.end(), -1);
+    for (size_t i = 0; i < n; ++i) {
+      const char* path = reads[begin + i].path.c_str();
+      io_uring_sqe& open = ring.push();
+      open.opcode = IORING_OP_OPENAT;
+      open.fd = AT_FDCWD;
+      open.addr = uintptr_t(path);
+      open.open_flags = O_RDONLY | O_CLOEXEC;
+      open.user_data = i * 2;
+      io_uring_sqe& stat = ring.push();
+      stat.opcode = IORING_OP_STATX;
+      stat.fd = AT_FDCWD;
+      stat.addr = uintptr_t(path);
+      stat.len = STATX_SIZE;
+      stat.off = uintptr_t(&stats[i]);
+      stat.user_data = i * 2 + 1;
+    }
+    int opened = ring.run([&](const io_uring_cqe& cqe) {
+      size_t i = cqe.user_data / 2;
+      header_read& r = reads[begin + i];
+      if (cqe.user_data % 2 == 0)
+        fds[i] = cqe.res;
+      else if (cqe.res == 0)
+        r.size = stats[i].stx_size;
+      if (cqe.res < 0 and r.error == 0)
+        r.error = -cqe.res;
+    });
+    if (opened == -1) {
+      for (size_t i = 0; i < n; ++i)
+        if (fds[i] >= 0)
+          ::close(fds[i]);
+      return begin == 0 ? -1 : int64_t(begin);
+    }
+
+    for (size_t i = 0; i < n; ++i) {
+      if (fds[i] < 0)
+        continue;
+      header_read& r = reads[begin + i];
+      if (r.error == 0) {
+        r.bytes.resize(min<uint64_t>(nbytes, r.size));
+        io_uring_sqe& read = ring.push();
+        read.opcode = IORING_OP_READ;
+        read.flags = IOSQE_IO_HARDLINK;
+        read.fd = fds[i];
+        read.addr = uintptr_t(r.bytes.data());
+        read.len = unsigned(r.bytes.size());
+        read.user_data = i * 2;
+      }
+      io_uring_sqe& close = ring.push();
+      close.opcode = IORING_OP_CLOSE;
+      close.fd = fds[i];
+      close.user_data = i * 2 + 1;
+    }
+    int read = ring.run([&](const io_uring_cqe& cqe) {
+      if (cqe.user_data % 2 != 0) {
+        fds[cqe.user_data / 2] = -1;
+        return;
+      }
+      header_read& r = reads[begin + cqe.user_data / 2];
+      if (cqe.res < 0) {
+        r.error = -cqe.res;
+        r.bytes.clear();
+      }
+      else
+        r.bytes.resize(size_t(cqe.res));
+    });
+    if (read == -1) {
+      for (size_t i = 0; i < n; ++i)
+        if (fds[i] >= 0)
+          ::close(fds[i]);
+      return int64_t(begin);
+    }
+    for (size_t i = 0; i < n; ++i)
+      if (reads[begin + i].error != 0)
+        reads[begin + i].size = 0;
+  }
+  return int64_t(reads.size());
+}
+
+#endif
+
+void read_headers(vector<header_read>& reads, size_t nbytes,
+                  thread_pool* pool) {
+  for (auto& r : reads)
+    replace(r.path.begin(), r.path.end(), '\\', '/');
+  size_t done = 0;
+#ifdef RRT_IO_URING
+  int64_t n = read_headers_uring(reads, nbytes);
+  if (n != -1)
+    done = size_t(n);
+#endif
+  if (done < reads.size()) {
+    for (size_t i = done; i < reads.size(); ++i)
+      reads[i] = {.path = move(reads[i].path)};
+    read_headers_from(reads, done, nbytes, pool);
+  }
+}
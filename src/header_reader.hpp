@@ -0,0 +1,28 @@
+#ifndef RRT_HEADER_READER_HPP
+#define RRT_HEADER_READER_HPP
+
+#include <cstdint>
+#include <string>
+#include <vector>
+
+class thread_pool;
+
+// The first bytes of a file, and its size.
+struct header_read {
+  std::string path;
+
+  // Filled in by read_headers(). `error` is the errno of the open or read
+  // that failed, or 0 if none did.
+  std::string bytes = "";
+  uint64_t size = 0;
+  int error = 0;
+};
+
+// Reads up to `nbytes` from the start of every file in `reads`. On Linux,
+// the opens, stats, reads and closes are submitted to io_uring in large
+// batches; where that isn't available (or the kernel refuses), the files are
+// read spread over `pool`, or one by one if it is null.
+void read_headers(std::vector<header_read>& reads, size_t nbytes,
+                  thread_pool* pool);
+
+#endif
@@ -0,0 +1,189 @@
+#include "image_header.hpp"
+
+#include <algorithm>
+#include <bit>
+#include <dcc/logger.hpp>
+
+using namespace std;
+
+// Larger than anything the game (or D3D9 hardware) handles.
+static constexpr uint32_t max_dimension = 16384;
+
+static uint32_t le16(string_view s, size_t at) {
+  return uint32_t(uint8_t(s[at])) | uint32_t(uint8_t(s[at + 1])) << 8;
+}
+
+static uint32_t le32(string_view s, size_t at) {
+  return le16(s, at) | le16(s, at + 2) << 16;
+}
+
+// Bytes per 4x4 block of the block-compressed formats, or per pixel
+// (negated) of the others.
+struct pixel_format {
+  string_view name;
+  int bytes;
+};
+
+static const pixel_format fourcc_formats[] = {
+  {"DXT1", 8},  {"DXT2", 16}, {"DXT3", 16}, {"DXT4", 16}, {"DXT5", 16},
+  {"ATI1", 8},  {"BC4U", 8},  {"BC4S", 8},  {"ATI2", 16}, {"BC5U", 16},
+  {"BC5S", 16},
+};
+
+static pixel_format dxgi_format(uint32_t dxgi) {
+  if (dxgi >= 70 and dxgi <= 72)
+    return {"BC1", 8};
+  if (dxgi >= 73 and dxgi <= 75)
+    return {"BC2", 16};
+  if (dxgi >= 76 and dxgi <= 78)
+    return {"BC3", 16};
+  if (dxgi >= 79 and dxgi <= 81)
+    return {"BC4", 8};
+  if (dxgi >= 82 and dxgi <= 84)
+    return {"BC5", 16};
+  if (dxgi >= 94 and dxgi <= 96)
+    return {"BC6H", 16};
+  if (dxgi >= 97 and dxgi <= 99)
+    return {"BC7", 16};
+  if (dxgi >= 27 and dxgi <= 32)
+    return {"R8G8B8A8", -4};
+  if (dxgi == 87 or dxgi == 88 or dxgi == 90 or dxgi == 91)
+    return {"B8G8R8A8", -4};
+  if (dxgi == 10)
+    return {"R16G16B16A16_FLOAT", -8};
+  if (dxgi == 2)
+    return {"R32G32B32A32_FLOAT", -16};
+  return {"", 0};
+}
+
+string inspect_dds(string_view head, uint64_t size, image_info& info) {
+  if (not head.starts_with("DDS "))
+    return "not a DDS file";
+  if (head.size() < 128)
+    return fmt::format("truncated header, {} of 128 bytes", head.size());
+  if (le32(head, 4) != 124 or le32(head, 76) != 32)
+    return "malformed header";
+
+  uint32_t flags = le32(head, 8);
+  info.height = le32(head, 12);
+  info.width = le32(head, 16);
+  info.mips = (flags & 0x20000) and le32(head, 28) != 0 ? le32(head, 28) : 1;
+  if (info.width == 0 or info.height == 0 or info.width > max_dimension or
+      info.height > max_dimension)
+    return fmt::format("invalid dimensions {}x{}", info.width, info.height);
+  uint32_t max_mips = bit_width(max(info.width, info.height));
+  if (info.mips > max_mips)
+    return fmt::format("{} mips for {}x{}, which has at most {}", info.mips,
+                       info.width, info.height, max_mips);
+
+  uint32_t pf_flags = le32(head, 80);
+  string_view fourcc = head.substr(84, 4);
+  uint32_t bits = le32(head, 88);
+  uint64_t header_size = 128;
+  int bytes = 0;
+  if ((pf_flags & 0x4) and fourcc == "DX10") {
+    if (head.size() < 148)
+      return fmt::format("truncated header, {} of 148 bytes", head.size());
+    header_size = 148;
+    pixel_format pf = dxgi_format(le32(head, 128));
+    if (pf.bytes == 0)
+      return fmt::format("unsupported DXGI format {}", le32(head, 128));
+    info.format = pf.name;
+    bytes = pf.bytes;
+  }
+  else if (pf_flags & 0x4) {
+    auto it = find_if(begin(fourcc_formats), end(fourcc_formats),
+                      [fourcc](const auto& f) { return f.name == fourcc; });
+    if (it == end(fourcc_formats))
+      return fmt::format("unsupported pixel format 0x{:08x}",
+                         le32(head, 84));
+    info.format = it->name;
+    bytes = it->bytes;
+  }
+  else if (pf_flags & (0x40 | 0x20000 | 0x2)) {
+    if (bits != 8 and bits != 16 and bits != 24 and bits != 32)
+      return fmt::format("unsupported {}-bit pixel format", bits);
+    string_view kind = pf_flags & 0x40       ? "RGB"
+                       : pf_flags & 0x20000 ? "luminance"
+                                            : "alpha";
+    info.format = fmt::format("{}-bit {}{}", bits, kind,
+                              (pf_flags & 0x41) == 0x41 ? "A" : "");
+    bytes = -int(bits / 8);
+  }
+  else
+    return "unknown pixel format";
+
+  // Volume textures don't tell how deep their mips are.
+  uint32_t caps2 = le32(head, 112);
+  if (caps2 & 0x200000) {
+    info.expected_size = 0;
+    return "";
+  }
+  uint64_t data_size = 0;
+  for (uint32_t m = 0; m < info.mips; ++m) {
+    uint64_t w = max(info.width >> m, 1u);
+    uint64_t h = max(info.height >> m, 1u);
+    data_size += bytes > 0 ? (w + 3) / 4 * ((h + 3) / 4) * bytes
+                           : w * h * uint64_t(-bytes);
+  }
+  if (caps2 & 0x200) {
+    int faces = popcount(caps2 & 0xfc00);
+    data_size *= faces == 0 ? 6 : faces;
+  }
+  info.expected_size = header_size + data_size;
+  if (size < info.expected_size)
+    return fmt::format("truncated, {} of {} bytes", size, info.expected_size);
+  return "";
+}
+
+string inspect_tga(string_view head, uint64_t size, image_info& info) {
+  if (head.size() < 18)
+    return fmt::format("truncated header, {} of 18 bytes", head.size());
+  uint32_t id_size = uint8_t(head[0]);
+  uint32_t colour_map_type = uint8_t(head[1]);
+  uint32_t image_type = uint8_t(head[2]);
+  uint32_t colour_map_size = le16(head, 5);
+  uint32_t colour_map_bits = uint8_t(head[7]);
+  uint32_t bits = uint8_t(head[16]);
+  info.width = le16(head, 12);
+  info.height = le16(head, 14);
+  info.mips = 1;
+
+  // TGAs have no magic, so these are what tells them from other files.
+  bool colour_mapped = image_type == 1 or image_type == 9;
+  bool true_colour = image_type == 2 or image_type == 10;
+  bool greyscale = image_type == 3 or image_type == 11;
+  if (not colour_mapped and not true_colour and not greyscale)
+    return fmt::format("not a TGA file, or one without an image (type {})",
+                       image_type);
+  if (colour_map_type > 1 or (colour_mapped and colour_map_type != 1))
+    return fmt::format("not a TGA file (colour map type {})", colour_map_type);
+  if (info.width == 0 or info.height == 0)
+    return fmt::format("invalid dimensions {}x{}", info.width, info.height);
+  bool valid_bits = true_colour ? bits == 15 or bits == 16 or bits == 24 or
+                                    bits == 32
+                                : bits == 8 or bits == 16;
+  if (not valid_bits)
+    return fmt::format("unsupported {}-bit pixel format", bits);
+
+  bool rle = image_type >= 9;
+  info.format = fmt::format("{}-bit {}{}", bits,
+                            true_colour ? "true colour"
+                            : greyscale ? "greyscale"
+                                        : "colour-mapped",
+                            rle ? " RLE" : "");
+  uint64_t header_size =
+    18 + id_size + colour_map_type * colour_map_size *
+                     ((colour_map_bits + 7) / 8);
+  if (rle) {
+    info.expected_size = 0;
+    if (size <= header_size)
+      return "no image data";
+    return "";
+  }
+  info.expected_size =
+    header_size + uint64_t(info.width) * info.height * ((bits + 7) / 8);
+  if (size < info.expected_size)
+    return fmt::format("truncated, {} of {} bytes", size, info.expected_size);
+  return "";
+}
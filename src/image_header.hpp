@@ -0,0 +1,33 @@
+#ifndef RRT_IMAGE_HEADER_HPP
+#define RRT_IMAGE_HEADER_HPP
+
+#include <cstdint>
+#include <string>
+#include <string_view>
+
+// What the header of a texture or unit card says about it.
+struct image_info {
+  std::string format = "";
+  uint32_t width = 0;
+  uint32_t height = 0;
+  uint32_t mips = 1;
+
+  // Size the file should at least have, 0 if it can't be told from the
+  // header (run-length encoded TGAs).
+  uint64_t expected_size = 0;
+};
+
+// The most a header (DX10 extension included) takes, so enough to read of
+// any file passed to inspect_dds() or inspect_tga().
+inline constexpr size_t image_header_size = 148;
+
+// Inspect the start of a DDS or TGA file of `size` bytes: its magic,
+// dimensions, pixel format and mip count, and whether the file holds all of
+// the data they call for. Return what's wrong with it, or an empty string if
+// nothing is.
+std::string inspect_dds(std::string_view head, uint64_t size,
+                        image_info& info);
+std::string inspect_tga(std::string_view head, uint64_t size,
+                        image_info& info);
+
+#endif
@@ -0,0 +1,72 @@
+#ifndef RRT_KEYWORD_TABLE_HPP
+#define RRT_KEYWORD_TABLE_HPP
+
+#include <array>
+#include <bit>
+#include <cstdint>
+#include <string_view>
+#include <utility>
+
+// The keywords of a definition file, fixed at compile time. They are found
+// through a perfect hash, its seed picked by the compiler so that no two of
+// them land in the same slot: one hash, one load and one comparison, where
+// a hash map would also chase buckets.
+template <size_t N>
+class keyword_table {
+public:
+  consteval keyword_table(const std::array<std::string_view, N>& keywords)
+      : keywords(keywords) {
+    for (seed = 1;; ++seed) {
+      slots.fill(N);
+      bool clash = false;
+      for (size_t i = 0; i < N and not clash; ++i) {
+        uint8_t& slot = slots[index(keywords[i])];
+        clash = slot != N;
+        slot = uint8_t(i);
+      }
+      if (not clash)
+        return;
+    }
+  }
+
+  // The index of `kw` among the keywords, or N if it isn't one of them.
+  constexpr size_t find(std::string_view kw) const {
+    size_t i = slots[index(kw)];
+    return i != N and keywords[i] == kw ? i : N;
+  }
+
+  static constexpr size_t size() { return N; }
+
+private:
+  static_assert(N > 0 and N < 256);
+
+  static constexpr size_t nslots = std::bit_ceil(N * 2);
+
+  // The slot of `s`: the top bits of its seeded FNV-1a hash, as the low ones
+  // only depend on the low bits of the seed.
+  constexpr size_t index(std::string_view s) const {
+    uint32_t h = 2166136261u ^ seed;
+    for (char c : s)
+      h = (h ^ uint8_t(c)) * 16777619u;
+    return h >> (32 - std::countr_zero(nslots));
+  }
+
+  std::array<std::string_view, N> keywords;
+  std::array<uint8_t, nslots> slots = {};
+  uint32_t seed = 0;
+};
+
+// Calls the handler of `kw`, the handlers being given in the order of the
+// keywords of `table`. Every call is a direct one, so that the handlers can
+// be inlined into the parsing loop. Returns false if `kw` isn't a keyword.
+template <size_t N, class... Handlers>
+bool dispatch(const keyword_table<N>& table, std::string_view kw,
+              Handlers&&... handlers) {
+  static_assert(sizeof...(Handlers) == N, "one handler per keyword");
+  size_t i = table.find(kw);
+  return [&]<size_t... I>(std::index_sequence<I...>) {
+    return ((i == I ? (handlers(), true) : false) or ...);
+  }(std::index_sequence_for<Handlers...>{});
+}
+
+#endif
@@ -0,0 +1,154 @@
+#include "local_socket.hpp"
+
+#include <cerrno>
+#include <cstring>
+
+#ifndef _WIN32
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <unistd.h>
+#endif
+
+using namespace std;
+
+#ifndef _WIN32
+
+static int to_address(string_view path, sockaddr_un& addr) {
+  addr = {};
+  addr.sun_family = AF_UNIX;
+  if (path.size() >= sizeof(addr.sun_path)) {
+    errno = ENAMETOOLONG;
+    return -1;
+  }
+  memcpy(addr.sun_path, path.data(), path.size());
+  return 0;
+}
+
+int listen_local(string_view path) {
+  sockaddr_un addr;
+  if (to_address(path, addr) == -1)
+    return -1;
+  int fd = socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0);
+  if (fd == -1)
+    return -1;
+
+  // A daemon that didn't get to clean up leaves its socket behind.
+  unlink(addr.sun_path);
+  if (bind(fd, (const sockaddr*)&addr, sizeof(addr)) == -1 or
+      listen(fd, 16) == -1) {
+    int e = errno;
+    close(fd);
+    errno = e;
+    return -1;
+  }
+  return fd;
+}
+
+int accept_local(int listener) {
+  return accept4(listener, nullptr, nullptr, SOCK_CLOEXEC);
+}
+
+int connect_local(string_view path) {
+  sockaddr_un addr;
+  if (to_address(path, addr) == -1)
+    return -1;
+  int fd = socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0);
+  if (fd == -1)
+    return -1;
+  if (connect(fd, (const sockaddr*)&addr, sizeof(addr)) == -1) {
+    int e = errno;
+    close(fd);
+    errno = e;
+    return -1;
+  }
+  return fd;
+}
+
+int send_all(int fd, string_view data) {
+  while (not data.empty()) {
+    ssize_t n = send(fd, data.data(), data.size(), MSG_NOSIGNAL);
+    if (n == -1 and errno == EINTR)
+      continue;
+    if (n == -1)
+      return -1;
+    data.remove_prefix(size_t(n));
+  }
+  return 0;
+}
+
+int receive(int fd, string& buf) {
+  char chunk[64 * 1024];
+  for (;;) {
+    ssize_t n = recv(fd, chunk, sizeof(chunk), 0);
+    if (n == -1 and errno == EINTR)
+      continue;
+    if (n == -1)
+      return -1;
+    buf.append(chunk, size_t(n));
+    return n == 0 ? 0 : 1;
+  }
+}
+
+int read_line(int fd, string& buf, string& line) {
+  size_t end;
+  while ((end = buf.find('\n')) == string::npos) {
+    if (int r = receive(fd, buf); r != 1)
+      return r;
+  }
+  line.assign(buf, 0, end);
+  buf.erase(0, end + 1);
+  return 1;
+}
+
+int read_bytes(int fd, string& buf, size_t n, string& out) {
+  while (buf.size() < n) {
+    if (int r = receive(fd, buf); r != 1)
+      return r;
+  }
+  out.assign(buf, 0, n);
+  buf.erase(0, n);
+  return 1;
+}
+
+void close_local(int fd) { close(fd); }
+
+#else
+
+int listen_local(string_view) {
+  errno = ENOSYS;
+  return -1;
+}
+
+int accept_local(int) {
+  errno = ENOSYS;
+  return -1;
+}
+
+int connect_local(string_view) {
+  errno = ENOSYS;
+  return -1;
+}
+
+int send_all(int, string_view) {
+  errno = ENOSYS;
+  return -1;
+}
+
+int receive(int, string&) {
+  errno = ENOSYS;
+  return -1;
+}
+
+int read_line(int, string&, string&) {
+  errno = ENOSYS;
+  return -1;
+}
+
+int read_bytes(int, string&, size_t, string&) {
+  errno = ENOSYS;
+  return -1;
+}
+
+void close_local(int) {}
+
+#endif
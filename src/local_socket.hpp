@@ -0,0 +1,33 @@
+#ifndef RRT_LOCAL_SOCKET_HPP
+#define RRT_LOCAL_SOCKET_HPP
+
+#include <string>
+#include <string_view>
+
+// Stream sockets bound to a path, that the daemon and its client talk over.
+// Only implemented where there are Unix domain sockets (not Windows) for
+// now. Everything returns -1 on failure, with errno set.
+
+// Listens at `path`, replacing whatever socket was left there.
+int listen_local(std::string_view path);
+
+int accept_local(int listener);
+int connect_local(std::string_view path);
+
+int send_all(int fd, std::string_view data);
+
+// Appends what there is to read from `fd` to `buf`, waiting for something if
+// there is nothing yet. Returns 0 at the end of the stream, and 1 otherwise.
+int receive(int fd, std::string& buf);
+
+// Reads from `fd` until `buf` holds a whole line, and moves that line into
+// `line`, without its newline. Returns 0 if the stream ended before one did,
+// and 1 otherwise. What was read past the line stays in `buf`.
+int read_line(int fd, std::string& buf, std::string& line);
+
+// The same for the next `n` bytes.
+int read_bytes(int fd, std::string& buf, size_t n, std::string& out);
+
+void close_local(int fd);
+
+#endif
@@ -0,0 +1,122 @@
+#include "mapped_file.hpp"
+
+#include <cerrno>
+#include <string>
+#include <utility>
+
+#ifdef _WIN32
+#define NOMINMAX
+#define WIN32_LEAN_AND_MEAN
+#include <windows.h>
+#else
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+using namespace std;
+
+mapped_file::mapped_file(mapped_file&& other) noexcept { *this = move(other); }
+
+mapped_file& mapped_file::operator=(mapped_file&& other) noexcept {
+  if (this != &other) {
+    close();
+    data = exchange(other.data, nullptr);
+    size = exchange(other.size, 0);
+#ifdef _WIN32
+    mapping = exchange(other.mapping, nullptr);
+#endif
+  }
+  return *this;
+}
+
+mapped_file::~mapped_file() { close(); }
+
+#ifdef _WIN32
+
+int mapped_file::open(string_view path) {
+  close();
+  HANDLE file = CreateFileA(string(path).c_str(), GENERIC_READ,
+                            FILE_SHARE_READ, nullptr, OPEN_EXISTING,
+                            FILE_ATTRIBUTE_NORMAL, nullptr);
+  if (file == INVALID_HANDLE_VALUE) {
+    errno = GetLastError() == ERROR_FILE_NOT_FOUND ? ENOENT : EACCES;
+    return -1;
+  }
+  LARGE_INTEGER fsize;
+  if (not GetFileSizeEx(file, &fsize)) {
+    CloseHandle(file);
+    errno = EIO;
+    return -1;
+  }
+  size = static_cast<size_t>(fsize.QuadPart);
+  if (size == 0) {
+    CloseHandle(file);
+    return 0;
+  }
+  mapping = CreateFileMappingA(file, nullptr, PAGE_READONLY, 0, 0, nullptr);
+  CloseHandle(file);
+  if (mapping == nullptr) {
+    size = 0;
+    errno = EIO;
+    return -1;
+  }
+  data = static_cast<const char*>(
+    MapViewOfFile(mapping, FILE_MAP_READ, 0, 0, 0));
+  if (data == nullptr) {
+    close();
+    errno = EIO;
+    return -1;
+  }
+  return 0;
+}
+
+void mapped_file::close() {
+  if (data != nullptr)
+    UnmapViewOfFile(data);
+  if (mapping != nullptr)
+    CloseHandle(mapping);
+  data = nullptr;
+  mapping = nullptr;
+  size = 0;
+}
+
+#else
+
+int mapped_file::open(string_view path) {
+  close();
+  int fd = ::open(string(path).c_str(), O_RDONLY);
+  if (fd == -1)
+    return -1;
+  struct stat st;
+  if (fstat(fd, &st) == -1) {
+    ::close(fd);
+    return -1;
+  }
+  size = static_cast<size_t>(st.st_size);
+
+  // Zero-length mappings are not allowed, but an empty view does the job.
+  if (size == 0) {
+    ::close(fd);
+    return 0;
+  }
+  void* p = mmap(nullptr, size, PROT_READ, MAP_PRIVATE, fd, 0);
+  ::close(fd);
+  if (p == MAP_FAILED) {
+    size = 0;
+    return -1;
+  }
+  madvise(p, size, MADV_SEQUENTIAL);
+  data = static_cast<const char*>(p);
+  return 0;
+}
+
+void mapped_file::close() {
+  if (data != nullptr)
+    munmap(const_cast<char*>(data), size);
+  data = nullptr;
+  size = 0;
+}
+
+#endif
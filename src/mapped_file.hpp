@@ -0,0 +1,31 @@
+#ifndef RRT_MAPPED_FILE_HPP
+#define RRT_MAPPED_FILE_HPP
+
+#include <string_view>
+
+// Read-only memory mapping of a whole file. Views into it stay valid for as
+// long as the mapped_file lives.
+class mapped_file {
+public:
+  mapped_file() = default;
+  mapped_file(const mapped_file&) = delete;
+  mapped_file& operator=(const mapped_file&) = delete;
+  mapped_file(mapped_file&& other) noexcept;
+  mapped_file& operator=(mapped_file&& other) noexcept;
+  ~mapped_file();
+
+  // Maps the file at `path`. Returns -1 on failure, with errno set.
+  int open(std::string_view path);
+  void close();
+
+  std::string_view view() const { return {data, size}; }
+
+private:
+  const char* data = nullptr;
+  size_t size = 0;
+#ifdef _WIN32
+  void* mapping = nullptr;
+#endif
+};
+
+#endif
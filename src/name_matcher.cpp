@@ -0,0 +1,120 @@
+#include "name_matcher.hpp"
+
+#include <algorithm>
+
+using namespace std;
+
+static char fold(char c) { return c >= 'A' and c <= 'Z' ? c - 'A' + 'a' : c; }
+
+static bool word_char(char c) {
+  return (c >= 'a' and c <= 'z') or (c >= 'A' and c <= 'Z') or
+         (c >= '0' and c <= '9') or c == '_';
+}
+
+uint32_t name_matcher::add(string_view name) {
+  string folded(name);
+  transform(folded.begin(), folded.end(), folded.begin(), fold);
+  auto [it, added] = indices.try_emplace(folded, uint32_t(names.size()));
+  if (added)
+    names.push_back(move(folded));
+  return it->second;
+}
+
+void name_matcher::build() {
+  classes.fill(0);
+  nclasses = 1;
+  for (const auto& name : names) {
+    for (char c : name) {
+      uint8_t& k = classes[uint8_t(c)];
+      if (k == 0)
+        k = uint8_t(nclasses++);
+    }
+  }
+  for (char c = 'A'; c <= 'Z'; ++c)
+    classes[uint8_t(c)] = classes[uint8_t(fold(c))];
+
+  // The trie of the names first, with `none` where it has no edge.
+  next.assign(nclasses, none);
+  output.assign(1, none);
+  lengths.assign(names.size(), 0);
+  for (uint32_t i = 0; i < names.size(); ++i) {
+    uint32_t s = 0;
+    for (char c : names[i]) {
+      uint32_t& t = next[s * nclasses + classes[uint8_t(c)]];
+      if (t == none) {
+        t = uint32_t(output.size());
+        output.push_back(none);
+        next.resize(next.size() + nclasses, none);
+      }
+      s = next[s * nclasses + classes[uint8_t(c)]];
+    }
+    if (not names[i].empty())
+      output[s] = i;
+    lengths[i] = uint32_t(names[i].size());
+  }
+
+  // Then breadth first, the missing edges of each state are those of the
+  // longest proper suffix of it that is in the trie, which is done by then.
+  // Class 0 always leads back to the root.
+  vector<uint32_t> fail(output.size(), 0);
+  suffix_output.assign(output.size(), none);
+  vector<uint32_t> queue;
+  for (size_t k = 0; k < nclasses; ++k) {
+    uint32_t& t = next[k];
+    if (t == none or k == 0)
+      t = 0;
+    else
+      queue.push_back(t);
+  }
+  for (size_t q = 0; q < queue.size(); ++q) {
+    uint32_t s = queue[q];
+    uint32_t f = fail[s];
+    suffix_output[s] = output[f] != none ? f : suffix_output[f];
+    for (size_t k = 0; k < nclasses; ++k) {
+      uint32_t& t = next[s * nclasses + k];
+      if (t == none or k == 0)
+        t = next[f * nclasses + k];
+      else {
+        fail[t] = next[f * nclasses + k];
+        queue.push_back(t);
+      }
+    }
+  }
+}
+
+vector<name_matcher::match> name_matcher::find(string_view text) const {
+  vector<match> found;
+  if (next.empty())
+    return found;
+  auto whole = [&text](size_t offset, size_t size) {
+    size_t end = offset + size;
+    return (offset == 0 or not word_char(text[offset - 1]) or
+            not word_char(text[offset])) and
+           (end == text.size() or not word_char(text[end]) or
+            not word_char(text[end - 1]));
+  };
+  uint32_t s = 0;
+  for (size_t i = 0; i < text.size(); ++i) {
+    s = next[s * nclasses + classes[uint8_t(text[i])]];
+    for (uint32_t o = output[s] != none ? s : suffix_output[s]; o != none;
+         o = suffix_output[o]) {
+      uint32_t name = output[o];
+      size_t offset = i + 1 - lengths[name];
+      if (whole(offset, lengths[name]))
+        found.push_back({name, offset, lengths[name]});
+    }
+  }
+
+  // Names are found by where they end, so overlaps are settled afterwards.
+  sort(found.begin(), found.end(), [](const match& a, const match& b) {
+    return a.offset != b.offset ? a.offset < b.offset : a.size > b.size;
+  });
+  size_t end = 0;
+  erase_if(found, [&end](const match& m) {
+    if (m.offset < end)
+      return true;
+    end = m.offset + m.size;
+    return false;
+  });
+  return found;
+}
@@ -0,0 +1,58 @@
+#ifndef RRT_NAME_MATCHER_HPP
+#define RRT_NAME_MATCHER_HPP
+
+#include <array>
+#include <cstdint>
+#include <string>
+#include <string_view>
+#include <unordered_map>
+#include <vector>
+
+// Finds where any of a set of names occurs in a text, in a single pass over
+// it however many names there are (an Aho-Corasick automaton). Case is
+// ignored for ASCII, and only whole names are found: a name starting or
+// ending in a letter, digit or underscore can't have one right before or
+// after it. Where found names overlap, the one starting first wins, and of
+// those starting at the same place, the longest.
+class name_matcher {
+public:
+  struct match {
+    uint32_t name;
+    size_t offset;
+    size_t size;
+  };
+
+  // Adds `name`, and returns the index its matches will have. Names that
+  // only differ in case share one. Empty names are never found.
+  uint32_t add(std::string_view name);
+
+  // Builds the automaton from the names added so far, which find() needs.
+  void build();
+
+  // The matches in `text`, in the order they occur.
+  std::vector<match> find(std::string_view text) const;
+
+  size_t size() const { return names.size(); }
+
+private:
+  static constexpr uint32_t none = UINT32_MAX;
+
+  // Names are kept folded.
+  std::vector<std::string> names;
+  std::unordered_map<std::string, uint32_t> indices;
+
+  // Bytes no name has all go to class 0, so that the table only needs a
+  // column for each byte that is in some name.
+  std::array<uint8_t, 256> classes = {};
+  size_t nclasses = 1;
+
+  // The automaton, with a row of nclasses transitions per state. Each
+  // state has the name that ends there, if any, and the next state down its
+  // chain of suffixes that has one.
+  std::vector<uint32_t> next;
+  std::vector<uint32_t> output;
+  std::vector<uint32_t> suffix_output;
+  std::vector<uint32_t> lengths;
+};
+
+#endif
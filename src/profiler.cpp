@@ -0,0 +1,214 @@
+#include "profiler.hpp"
+
+#include <cstdlib>
+#include <dcc/logger.hpp>
+#include <filesystem>
+#include <fstream>
+#include <map>
+#include <new>
+
+#include "common.hpp"
+
+#ifndef _WIN32
+#include <sys/resource.h>
+#endif
+
+using namespace std;
+namespace fs = std::filesystem;
+
+profiler prof;
+
+// Once --stats or --trace enable the profiler, every heap allocation of the
+// program is counted here, so that --stats can tell how many there were, and
+// spans how many were made while they lasted. Each thread counts into a slot
+// of its own, on a cache line of its own (past slot_count threads, slots are
+// shared), and totals sum the slots. Constant-initialized, as allocations
+// happen before prof is constructed.
+namespace {
+
+struct alignas(64) allocation_slot {
+  atomic<uint64_t> n = 0;
+};
+
+constexpr size_t slot_count = 64;
+constinit allocation_slot slots[slot_count];
+constinit atomic<size_t> next_slot = 0;
+constinit atomic<bool> counting = false;
+constinit thread_local allocation_slot* slot = nullptr;
+
+} // namespace
+
+static uint64_t allocations_made() {
+  uint64_t n = 0;
+  for (const auto& s : slots)
+    n += s.n.load(memory_order_relaxed);
+  return n;
+}
+
+void* operator new(size_t n) {
+  if (counting.load(memory_order_relaxed)) {
+    if (not slot)
+      slot = &slots[next_slot.fetch_add(1, memory_order_relaxed) % slot_count];
+    slot->n.fetch_add(1, memory_order_relaxed);
+  }
+  if (void* p = malloc(n ? n : 1))
+    return p;
+  throw bad_alloc();
+}
+
+// GCC takes any free() in an operator delete for one of memory that came from
+// operator new, not knowing that ours uses malloc().
+#if defined(__GNUC__) and not defined(__clang__)
+#pragma GCC diagnostic push
+#pragma GCC diagnostic ignored "-Wmismatched-new-delete"
+#endif
+void operator delete(void* p) noexcept { free(p); }
+void operator delete(void* p, size_t) noexcept { free(p); }
+#if defined(__GNUC__) and not defined(__clang__)
+#pragma GCC diagnostic pop
+#endif
+
+// The peak resident set size of the process so far, in KiB, or 0 where it
+// isn't known.
+static uint64_t peak_rss_kib() {
+#ifndef _WIN32
+  rusage usage;
+  if (getrusage(RUSAGE_SELF, &usage) == 0)
+    return uint64_t(usage.ru_maxrss);
+#endif
+  return 0;
+}
+
+thread_local shared_ptr<profiler::thread_log> profiler::current_log;
+
+profiler::span::span(string_view name, bool detail)
+  : detail(detail), active(prof.on and (not detail or prof.detail)) {
+  if (not active)
+    return;
+  this->name = name;
+  start = chrono::steady_clock::now();
+  allocations_before = allocations_made();
+}
+
+profiler::span::~span() {
+  if (active)
+    prof.record(name, detail, start, allocations_made() - allocations_before);
+}
+
+profiler::profiler() : epoch(chrono::steady_clock::now()) {}
+
+uint64_t profiler::allocations_so_far() const {
+  return allocations_made() - allocations_before;
+}
+
+void profiler::enable(bool detailed) {
+  on = true;
+  detail = detailed;
+  counting = true;
+}
+
+void profiler::count_parsed(size_t bytes, size_t entries) {
+  count.bytes_parsed += bytes;
+  count.entries_parsed += entries;
+}
+
+void profiler::count_parsed(string_view path, size_t entries) {
+  error_code ec;
+  uintmax_t size = fs::file_size(path, ec);
+  count_parsed(ec ? 0 : size, entries);
+}
+
+void profiler::reset() {
+  lock_guard l(m);
+  for (auto& log : logs)
+    log->events.clear();
+  count.bytes_parsed = 0;
+  count.entries_parsed = 0;
+  count.probes = 0;
+  count.cache_hits = 0;
+  count.problems = 0;
+  allocations_before = allocations_made();
+}
+
+profiler::thread_log& profiler::local() {
+  if (not current_log) {
+    auto log = make_shared<thread_log>();
+    lock_guard l(m);
+    log->tid = logs.size() + 1;
+    logs.push_back(log);
+    current_log = log;
+  }
+  return *current_log;
+}
+
+void profiler::record(string_view name, bool detail,
+                      chrono::steady_clock::time_point start,
+                      uint64_t allocations) {
+  auto end = chrono::steady_clock::now();
+  auto us = [](chrono::steady_clock::duration d) {
+    return chrono::duration_cast<chrono::microseconds>(d).count();
+  };
+  local().events.push_back(
+    {string(name), detail, us(start - epoch), us(end - start), allocations});
+}
+
+void profiler::print_stats(FILE* f) const {
+  lock_guard l(m);
+
+  // Ordered by name, so that runs can be diffed.
+  struct totals {
+    int64_t us = 0;
+    size_t n = 0;
+    uint64_t allocations = 0;
+  };
+  map<string_view, totals> phases;
+  for (const auto& log : logs) {
+    for (const auto& e : log->events) {
+      if (e.detail)
+        continue;
+      auto& t = phases[e.name];
+      t.us += e.duration_us;
+      ++t.n;
+      t.allocations += e.allocations;
+    }
+  }
+  fmt::print(f, "{{\n  \"bytes_parsed\": {},\n  \"entries_parsed\": {},\n"
+                "  \"probes\": {},\n  \"cache_hits\": {},\n"
+                "  \"problems\": {},\n  \"allocations\": {},\n"
+                "  \"peak_rss_kib\": {},\n  \"phases\": {{",
+             count.bytes_parsed.load(), count.entries_parsed.load(),
+             count.probes.load(), count.cache_hits.load(),
+             count.problems.load(), allocations_so_far(), peak_rss_kib());
+  const char* sep = "\n";
+  for (const auto& [name, t] : phases) {
+    fmt::print(f,
+               "{}    \"{}\": {{\"ms\": {:.3f}, \"count\": {}, "
+               "\"allocations\": {}}}",
+               sep, json_escape(name), t.us / 1000.0, t.n, t.allocations);
+    sep = ",\n";
+  }
+  fmt::print(f, "{}}}\n}}\n", phases.empty() ? "" : "\n  ");
+}
+
+int profiler::write_trace(string_view path) const {
+  ofstream f(string(path), ios::binary);
+  if (not f)
+    return -1;
+  lock_guard l(m);
+  string buf = "{\"displayTimeUnit\": \"ms\", \"traceEvents\": [\n";
+  const char* sep = "";
+  for (const auto& log : logs) {
+    for (const auto& e : log->events) {
+      buf += fmt::format("{}{{\"name\": \"{}\", \"cat\": \"{}\", "
+                         "\"ph\": \"X\", \"ts\": {}, \"dur\": {}, "
+                         "\"pid\": 1, \"tid\": {}}}",
+                         sep, json_escape(e.name),
+                         e.detail ? "entry" : "phase", e.start_us,
+                         e.duration_us, log->tid);
+      sep = ",\n";
+    }
+  }
+  buf += "\n]}\n";
+  f.write(buf.data(), buf.size());
+  return f ? 0 : -1;
+}
@@ -0,0 +1,104 @@
+#ifndef RRT_PROFILER_HPP
+#define RRT_PROFILER_HPP
+
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <cstdio>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <string_view>
+#include <vector>
+
+// Counters and timed spans of a run, for --stats and --trace. Counting is
+// always on and cheap; spans are only recorded once enabled.
+class profiler {
+public:
+  struct counters {
+    std::atomic<uint64_t> bytes_parsed = 0;
+    std::atomic<uint64_t> entries_parsed = 0;
+    std::atomic<uint64_t> probes = 0;
+    std::atomic<uint64_t> cache_hits = 0;
+    std::atomic<uint64_t> problems = 0;
+  };
+
+  // Times its own lifetime, on the thread that created it. Detailed spans
+  // (e.g. one per entry) are only recorded when tracing.
+  class span {
+  public:
+    explicit span(std::string_view name, bool detail = false);
+    span(const span&) = delete;
+    span& operator=(const span&) = delete;
+    ~span();
+
+  private:
+    std::string name;
+    bool detail;
+    bool active;
+    std::chrono::steady_clock::time_point start;
+    uint64_t allocations_before;
+  };
+
+  profiler();
+
+  void enable(bool detailed);
+  bool detailed() const { return detail; }
+
+  // Adds to the bytes and entries parsed, the bytes being those of `path`.
+  void count_parsed(size_t bytes, size_t entries);
+  void count_parsed(std::string_view path, size_t entries);
+
+  // Forgets everything recorded so far, when nothing is being recorded.
+  void reset();
+
+  // Heap allocations made since the profiler was enabled, or since the last
+  // reset(), by all threads.
+  uint64_t allocations_so_far() const;
+
+  // Prints counters, and the total time and heap allocations of each kind
+  // of span, as JSON. Allocations are only counted once enabled.
+  void print_stats(FILE* f) const;
+
+  // Writes every span in the Chrome trace event format, to be opened in
+  // chrome://tracing or Perfetto. Returns -1 on failure, with errno set.
+  int write_trace(std::string_view path) const;
+
+  counters count;
+
+private:
+  struct event {
+    std::string name;
+    bool detail;
+    int64_t start_us;
+    int64_t duration_us;
+
+    // Heap allocations made by any thread while the span lasted, so those
+    // of spans running at the same time are counted by each of them.
+    uint64_t allocations;
+  };
+
+  // Spans of one thread, so recording them takes no lock.
+  struct thread_log {
+    size_t tid;
+    std::vector<event> events;
+  };
+
+  static thread_local std::shared_ptr<thread_log> current_log;
+
+  thread_log& local();
+  void record(std::string_view name, bool detail,
+              std::chrono::steady_clock::time_point start,
+              uint64_t allocations);
+
+  bool on = false;
+  bool detail = false;
+  uint64_t allocations_before = 0;
+  std::chrono::steady_clock::time_point epoch;
+  mutable std::mutex m;
+  std::vector<std::shared_ptr<thread_log>> logs;
+};
+
+extern profiler prof;
+
+#endif
@@ -0,0 +1,186 @@
+#include "report.hpp"
+
+#include <cmath>
+#include <cstdio>
+#include <dcc/logger.hpp>
+#include <fstream>
+#include <map>
+
+#include "common.hpp"
+
+using namespace std;
+using namespace dcc;
+
+// Drops the SGR escape sequences (colours) from a message.
+static string strip_sgr(string_view s) {
+  string plain;
+  plain.reserve(s.size());
+  for (size_t i = 0; i < s.size(); ++i) {
+    if (s[i] == '\x1b' and i + 1 < s.size() and s[i + 1] == '[') {
+      size_t end = s.find('m', i + 2);
+      if (end != string_view::npos) {
+        i = end;
+        continue;
+      }
+    }
+    plain += s[i];
+  }
+  return plain;
+}
+
+void report::add(string_view entity, string_view file, size_t lineno,
+                 vector<problem> problems) {
+  if (problems.empty())
+    return;
+  entries.push_back({string(entity), string(file), lineno, move(problems)});
+}
+
+void report::add_source(string_view path, size_t layer) {
+  sources.emplace(path, layer);
+}
+
+void report::name_layers(vector<string> names) { layers = move(names); }
+
+string report::render(report_format format) const {
+  switch (format) {
+  case report_format::json_lines:
+    return render_json_lines();
+  case report_format::sarif:
+    return render_sarif();
+  default:
+    return render_human();
+  }
+}
+
+string report::render_human() const {
+  string out;
+  for (size_t n = 0; n < entries.size(); ++n) {
+    const entry& e = entries[n];
+    out += fmt::format("\n{} {} at {}:\n",
+                       fmt::format(fg(fmt::color::white), "{})", n + 1),
+                       sgr::unique(e.entity),
+                       sgr::file(fmt::format("{}:{}", e.file, e.lineno)));
+    size_t count = e.problems.size();
+    for (size_t i = 0; i < count; ++i)
+      out += fmt::format("\t {} {}{}\n",
+                         fmt::format(fmt::fg(fmt::color::white), "{}.", i + 1),
+                         string(int(log10(count)) - int(log10(i + 1)), ' '),
+                         e.problems[i].message);
+  }
+  if (sources.empty())
+    return out;
+
+  // What the mod has itself goes without saying.
+  vector<vector<string_view>> found(layers.size());
+  for (const auto& [path, layer] : sources)
+    found[layer].push_back(path);
+  out += '\n';
+  for (size_t layer = 0; layer < found.size(); ++layer) {
+    out += fmt::format("{} references were satisfied by {}{}\n",
+                       sgr::semiunique(found[layer].size()),
+                       sgr::file(layers[layer]),
+                       layer == 0 or found[layer].empty() ? "." : ":");
+    if (layer != 0)
+      for (string_view path : found[layer])
+        out += fmt::format("\t {}\n", sgr::file(path));
+  }
+  return out;
+}
+
+string report::render_json_lines() const {
+  string out;
+  for (const auto& e : entries) {
+    for (const auto& p : e.problems) {
+      out += fmt::format(
+        "{{\"entity\": \"{}\", \"file\": \"{}\", \"line\": {}, "
+        "\"kind\": \"{}\", \"message\": \"{}\"",
+        json_escape(e.entity), json_escape(e.file), e.lineno,
+        json_escape(p.kind), json_escape(strip_sgr(p.message)));
+      if (not p.path.empty())
+        out += fmt::format(", \"path\": \"{}\"", json_escape(p.path));
+      if (not p.faction.empty())
+        out += fmt::format(", \"faction\": \"{}\"", json_escape(p.faction));
+      if (not p.file.empty() and p.lineno != 0)
+        out += fmt::format(", \"at\": \"{}:{}\"", json_escape(p.file),
+                           p.lineno);
+      else if (not p.file.empty())
+        out += fmt::format(", \"at\": \"{}\"", json_escape(p.file));
+      out += "}\n";
+    }
+  }
+  for (const auto& [path, layer] : sources)
+    out += fmt::format("{{\"kind\": \"resolved\", \"path\": \"{}\", "
+                       "\"layer\": \"{}\"}}\n",
+                       json_escape(path), json_escape(layers[layer]));
+  return out;
+}
+
+string report::render_sarif() const {
+  map<string_view, size_t> rules;
+  for (const auto& e : entries)
+    for (const auto& p : e.problems)
+      rules.emplace(p.kind, 0);
+  string out = "{\n  \"$schema\": "
+               "\"https://json.schemastore.org/sarif-2.1.0.json\",\n"
+               "  \"version\": \"2.1.0\",\n"
+               "  \"runs\": [{\n"
+               "    \"tool\": {\"driver\": {\"name\": \"verificator\", "
+               "\"rules\": [";
+  size_t index = 0;
+  for (auto& [kind, i] : rules) {
+    i = index++;
+    out += fmt::format("{}\n      {{\"id\": \"{}\"}}", i == 0 ? "" : ",",
+                       json_escape(kind));
+  }
+  out += "]}},\n    \"results\": [";
+  const char* sep = "\n";
+  for (const auto& e : entries) {
+    for (const auto& p : e.problems) {
+      string_view file = p.file.empty() ? e.file : p.file;
+      size_t lineno = p.file.empty() ? e.lineno : p.lineno;
+      string region =
+        lineno == 0 ? "" : fmt::format(", \"region\": {{\"startLine\": {}}}",
+                                       lineno);
+      out += fmt::format(
+        "{}      {{\"ruleId\": \"{}\", \"ruleIndex\": {}, \"level\": "
+        "\"error\", \"message\": {{\"text\": \"{}\"}}, \"locations\": "
+        "[{{\"physicalLocation\": {{\"artifactLocation\": {{\"uri\": \"{}\"}}"
+        "{}}}}}], \"properties\": {{\"entity\": \"{}\", \"path\": \"{}\", "
+        "\"faction\": \"{}\"}}}}",
+        sep, json_escape(p.kind), rules.at(p.kind),
+        json_escape(strip_sgr(p.message)), json_escape(file), region,
+        json_escape(e.entity), json_escape(p.path), json_escape(p.faction));
+      sep = ",\n";
+    }
+  }
+  out += "\n    ]";
+
+  // SARIF has no place for what was found, so it goes with the run.
+  if (not sources.empty()) {
+    out += ",\n    \"properties\": {\"resolved\": [";
+    sep = "\n";
+    for (const auto& [path, layer] : sources) {
+      out += fmt::format("{}      {{\"path\": \"{}\", \"layer\": \"{}\"}}",
+                         sep, json_escape(path), json_escape(layers[layer]));
+      sep = ",\n";
+    }
+    out += "\n    ]}";
+  }
+  out += "\n  }]\n}\n";
+  return out;
+}
+
+int report::write(report_format format, string_view path) {
+  string out = render(format);
+  entries.clear();
+  sources.clear();
+  if (path.empty()) {
+    if (fwrite(out.data(), 1, out.size(), stderr) != out.size())
+      return -1;
+    return fflush(stderr) == 0 ? 0 : -1;
+  }
+  ofstream f(string(path), ios::binary);
+  if (not f or not f.write(out.data(), out.size()))
+    return -1;
+  return 0;
+}
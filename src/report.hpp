@@ -0,0 +1,67 @@
+#ifndef RRT_REPORT_HPP
+#define RRT_REPORT_HPP
+
+#include <map>
+#include <string>
+#include <string_view>
+#include <vector>
+
+// Something wrong with an entry. `kind` identifies the check that failed,
+// and `file` and `lineno` point at the definition at fault, when that isn't
+// the entry itself.
+struct problem {
+  std::string kind;
+
+  // As shown to humans, colours included.
+  std::string message;
+  std::string path = "";
+  std::string faction = "";
+  std::string file = "";
+  size_t lineno = 0;
+
+  bool operator==(const problem&) const = default;
+};
+
+enum class report_format { human, json_lines, sarif };
+
+// Collects the problems of a run, so that they are rendered in one pass and
+// written at once.
+class report {
+public:
+  // Adds the problems of the entry `entity`, defined at `file`:`lineno`.
+  // Entries are numbered in the order they are added.
+  void add(std::string_view entity, std::string_view file, size_t lineno,
+           std::vector<problem> problems);
+
+  // Notes which layer satisfied the reference to `path`, for runs over a mod
+  // and the directories it is layered over. The layers are named in order,
+  // the mod first.
+  void add_source(std::string_view path, size_t layer);
+  void name_layers(std::vector<std::string> names);
+
+  std::string render(report_format format) const;
+
+  // Renders everything collected to `path`, or to stderr if it is empty, then
+  // forgets about it. Returns -1 on failure, with errno set.
+  int write(report_format format, std::string_view path);
+
+  size_t size() const { return entries.size(); }
+
+private:
+  struct entry {
+    std::string entity;
+    std::string file;
+    size_t lineno;
+    std::vector<problem> problems;
+  };
+
+  std::string render_human() const;
+  std::string render_json_lines() const;
+  std::string render_sarif() const;
+
+  std::vector<entry> entries;
+  std::vector<std::string> layers;
+  std::map<std::string, size_t> sources;
+};
+
+#endif
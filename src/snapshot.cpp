@@ -0,0 +1,615 @@
+#include "snapshot.hpp"
+
+#include <cerrno>
+#include <cstring>
+#include <filesystem>
+#include <fstream>
+#include <span>
+#include <type_traits>
+
+#include "mapped_file.hpp"
+#include "profiler.hpp"
+#include "verification_cache.hpp"
+
+using namespace std;
+namespace fs = std::filesystem;
+
+// Bumped whenever the layout below changes.
+static constexpr uint32_t snapshot_version = 2;
+static constexpr char snapshot_magic[8] = {'r', 'r', 't', 'w',
+                                           's', 'n', 'a', 'p'};
+
+namespace {
+
+// Where a string is in the pool.
+struct str_ref {
+  uint32_t offset;
+  uint32_t size;
+};
+
+// Where a run of elements is in one of the arrays.
+struct span_ref {
+  uint32_t first;
+  uint32_t count;
+};
+
+// The elements of a hash set or map, and the number of buckets it had, that
+// it is given again before being refilled so that it keeps its order.
+struct hashed_ref {
+  span_ref elements;
+  uint64_t buckets;
+};
+
+struct texture_record {
+  uint64_t lineno;
+
+  // Index into the atoms of the snapshot.
+  uint32_t owner;
+  uint32_t unused;
+  str_ref path;
+};
+
+struct pair_record {
+  str_ref key;
+  str_ref value;
+};
+
+// The records of each kind of entity. They have no padding, so that the
+// same entities make the same snapshot.
+
+struct unit_record {
+  uint64_t lineno;
+  uint32_t mercenary;
+  uint32_t unused;
+  str_ref type;
+  str_ref dictionary;
+  span_ref attributes;
+  span_ref owners;
+  span_ref soldiers;
+  span_ref officers;
+};
+
+struct battle_model_record {
+  uint64_t lineno;
+  str_ref dictionary;
+  span_ref textures;
+  span_ref pbr_textures;
+  hashed_ref model_paths;
+};
+
+struct strat_model_entry_record {
+  uint64_t lineno;
+  str_ref type;
+  str_ref last_faction;
+  hashed_ref models;
+  hashed_ref strat_cards;
+};
+
+struct strat_model_record {
+  uint64_t lineno;
+  str_ref type;
+  str_ref path;
+  str_ref nv_path;
+  span_ref textures;
+  span_ref pbr_textures;
+};
+
+struct banner_record {
+  uint64_t lineno;
+  str_ref type;
+  hashed_ref texture_paths;
+};
+
+enum class snapshot_kind : uint32_t {
+  units = 1,
+  battle_models,
+  strat_model_entries,
+  strat_models,
+  banners
+};
+
+enum section {
+  record_section,
+  string_section,
+  str_section,
+  index_section,
+  texture_section,
+  pair_section,
+  atom_section,
+  section_count
+};
+
+struct snapshot_header {
+  char magic[8];
+  uint32_t version;
+  snapshot_kind kind;
+  uint32_t record_size;
+  uint32_t unused;
+  uint64_t source_size;
+  uint64_t source_hash;
+
+  // Of the sections, in order, so that a snapshot damaged since it was
+  // saved isn't read as if it were right.
+  uint64_t content_hash;
+  uint64_t record_count;
+
+  // Of the hash map the records were in, if they were.
+  uint64_t buckets;
+
+  struct {
+    uint64_t offset;
+    uint64_t size;
+  } sections[section_count];
+};
+
+static_assert(is_trivially_copyable_v<snapshot_header>);
+static_assert(sizeof(texture_record) == 24 and sizeof(unit_record) == 64 and
+              sizeof(battle_model_record) == 48 and
+              sizeof(strat_model_entry_record) == 56 and
+              sizeof(strat_model_record) == 48 and
+              sizeof(banner_record) == 32);
+
+template <class T>
+string_view bytes_of(const vector<T>& v) {
+  return {reinterpret_cast<const char*>(v.data()), v.size() * sizeof(T)};
+}
+
+class snapshot_writer {
+public:
+  str_ref add(string_view s) {
+    str_ref r = {uint32_t(pool.size()), uint32_t(s.size())};
+    pool.append(s);
+    return r;
+  }
+
+  template <class R>
+  span_ref add_strings(const R& range) {
+    span_ref r = {uint32_t(strs.size()), uint32_t(range.size())};
+    for (const auto& s : range)
+      strs.push_back(add(s));
+    return r;
+  }
+
+  template <class Set>
+  hashed_ref add_set(const Set& set) {
+    return {add_strings(set), set.bucket_count()};
+  }
+
+  template <class Map>
+  hashed_ref add_map(const Map& map) {
+    span_ref r = {uint32_t(pairs.size()), uint32_t(map.size())};
+    for (const auto& [key, value] : map)
+      pairs.push_back({add(key), add(value)});
+    return {r, map.bucket_count()};
+  }
+
+  span_ref add_owners(const pmr::vector<atom>& owners) {
+    span_ref r = {uint32_t(indices.size()), uint32_t(owners.size())};
+    for (atom a : owners)
+      indices.push_back(atom_index(a));
+    return r;
+  }
+
+  span_ref add_textures(const texture_map<texture>& map) {
+    span_ref r = {uint32_t(textures.size()), uint32_t(map.size())};
+    for (const auto& [owner, t] : map)
+      textures.push_back({t.lineno, atom_index(owner), 0, add(t.path)});
+    return r;
+  }
+
+  template <class Record>
+  void add_record(const Record& r) {
+    records.append(reinterpret_cast<const char*>(&r), sizeof(r));
+    ++count;
+  }
+
+  // Writes the snapshot next to `path` first, so that a run reading it at
+  // the same time never sees half of it.
+  int save(string_view path, snapshot_kind kind, uint32_t record_size,
+           const snapshot_source& source, uint64_t buckets) const {
+    profiler::span span("save_snapshot");
+    string_view parts[section_count] = {
+      records,
+      pool,
+      bytes_of(strs),
+      bytes_of(indices),
+      bytes_of(textures),
+      bytes_of(pairs),
+      bytes_of(atoms_used)};
+    for (const auto& part : parts) {
+      if (part.size() > UINT32_MAX) {
+        errno = EFBIG;
+        return -1;
+      }
+    }
+    snapshot_header h = {};
+    memcpy(h.magic, snapshot_magic, sizeof(h.magic));
+    h.version = snapshot_version;
+    h.kind = kind;
+    h.record_size = record_size;
+    h.source_size = source.size;
+    h.source_hash = source.hash;
+    h.record_count = count;
+    h.buckets = buckets;
+    uint64_t offset = sizeof(h);
+    content_hasher content;
+    for (int i = 0; i < section_count; ++i) {
+      h.sections[i] = {offset, parts[i].size()};
+      offset += (parts[i].size() + 7) / 8 * 8;
+      content << parts[i];
+    }
+    h.content_hash = content.value();
+
+    string tmp = string(path) + ".tmp";
+    {
+      ofstream f(tmp, ios::binary | ios::trunc);
+      if (not f)
+        return -1;
+      const char padding[8] = {};
+      f.write(reinterpret_cast<const char*>(&h), sizeof(h));
+      for (const auto& part : parts) {
+        f.write(part.data(), part.size());
+        f.write(padding, (8 - part.size() % 8) % 8);
+      }
+      if (not f)
+        return -1;
+    }
+    error_code ec;
+    fs::rename(tmp, path, ec);
+    if (ec) {
+      errno = ec.value();
+      return -1;
+    }
+    return 0;
+  }
+
+private:
+  uint32_t atom_index(atom a) {
+    auto [it, added] = atom_indices.try_emplace(a, uint32_t(atoms_used.size()));
+    if (added)
+      atoms_used.push_back(add(atoms.name(a)));
+    return it->second;
+  }
+
+  string records;
+  uint64_t count = 0;
+  string pool;
+  vector<str_ref> strs;
+  vector<uint32_t> indices;
+  vector<texture_record> textures;
+  vector<pair_record> pairs;
+  vector<str_ref> atoms_used;
+  unordered_map<atom, uint32_t> atom_indices;
+};
+
+// Reads a mapped snapshot back. Whatever in it points outside of it makes
+// the snapshot `bad`, rather than being followed.
+class snapshot_reader {
+public:
+  int open(string_view path, snapshot_kind kind, uint32_t record_size,
+           const snapshot_source& source) {
+    if (file.open(path) == -1)
+      return -1;
+    string_view v = file.view();
+    if (v.size() < sizeof(h)) {
+      errno = EBADMSG;
+      return -1;
+    }
+    memcpy(&h, v.data(), sizeof(h));
+    if (memcmp(h.magic, snapshot_magic, sizeof(h.magic)) != 0 or
+        h.version != snapshot_version or h.kind != kind or
+        h.record_size != record_size or h.source_size != source.size or
+        h.source_hash != source.hash) {
+      errno = ESTALE;
+      return -1;
+    }
+    const size_t element_sizes[section_count] = {
+      record_size,
+      1,
+      sizeof(str_ref),
+      sizeof(uint32_t),
+      sizeof(texture_record),
+      sizeof(pair_record),
+      sizeof(str_ref)};
+    for (int i = 0; i < section_count; ++i) {
+      auto [offset, size] = h.sections[i];
+      if (offset % 8 != 0 or offset > v.size() or size > v.size() - offset or
+          size % element_sizes[i] != 0) {
+        errno = EBADMSG;
+        return -1;
+      }
+    }
+    if (h.record_count != h.sections[record_section].size / record_size) {
+      errno = EBADMSG;
+      return -1;
+    }
+    content_hasher content;
+    for (const auto& [offset, size] : h.sections)
+      content << v.substr(offset, size);
+    if (content.value() != h.content_hash) {
+      errno = EBADMSG;
+      return -1;
+    }
+    auto [pool_offset, pool_size] = h.sections[string_section];
+    pool = v.substr(pool_offset, pool_size);
+    for (str_ref name : section<str_ref>(atom_section))
+      owners.push_back(atoms.intern(str(name)));
+    return 0;
+  }
+
+  template <class T>
+  span<const T> section(int i) const {
+    const char* data = file.view().data() + h.sections[i].offset;
+    return {reinterpret_cast<const T*>(data), h.sections[i].size / sizeof(T)};
+  }
+
+  uint64_t buckets() const { return h.buckets; }
+
+  string_view str(str_ref r) {
+    if (r.offset > pool.size() or r.size > pool.size() - r.offset) {
+      bad = true;
+      return {};
+    }
+    return pool.substr(r.offset, r.size);
+  }
+
+  pmr::string string(str_ref r, pmr::memory_resource* mr) {
+    return pmr::string(str(r), mr);
+  }
+
+  pmr::vector<pmr::string> strings(span_ref r, pmr::memory_resource* mr) {
+    pmr::vector<pmr::string> v(mr);
+    auto refs = elements(section<str_ref>(str_section), r);
+    v.reserve(refs.size());
+    for (str_ref s : refs)
+      v.emplace_back(str(s));
+    return v;
+  }
+
+  pmr::vector<atom> owners_of(span_ref r, pmr::memory_resource* mr) {
+    pmr::vector<atom> v(mr);
+    for (uint32_t i : elements(section<uint32_t>(index_section), r))
+      v.push_back(owner(i));
+    return v;
+  }
+
+  texture_map<texture> textures_of(span_ref r, pmr::memory_resource* mr) {
+    texture_map<texture> map(mr);
+    for (const auto& t : elements(section<texture_record>(texture_section), r))
+      map.set(owner(t.owner), {t.lineno, string(t.path, mr)});
+    return map;
+  }
+
+  // Hash sets and maps are refilled backwards with the buckets they had,
+  // which gives them back the order they were saved in.
+
+  pmr::unordered_set<pmr::string> set_of(hashed_ref r,
+                                         pmr::memory_resource* mr) {
+    pmr::unordered_set<pmr::string> set(mr);
+    auto refs = elements(section<str_ref>(str_section), r.elements);
+    set.rehash(buckets_for(r.buckets, refs.size()));
+    for (auto it = refs.rbegin(); it != refs.rend(); ++it)
+      set.emplace(str(*it));
+    return set;
+  }
+
+  pmr::unordered_map<pmr::string, pmr::string>
+  map_of(hashed_ref r, pmr::memory_resource* mr) {
+    pmr::unordered_map<pmr::string, pmr::string> map(mr);
+    auto refs = elements(section<pair_record>(pair_section), r.elements);
+    map.rehash(buckets_for(r.buckets, refs.size()));
+    for (auto it = refs.rbegin(); it != refs.rend(); ++it)
+      map.emplace(str(it->key), str(it->value));
+    return map;
+  }
+
+  // Bucket counts a hash table of `size` elements could not have had are
+  // left to the table, as are the elements' order then.
+  size_t buckets_for(uint64_t buckets, size_t size) {
+    if (buckets > 4 * size + 64) {
+      bad = true;
+      return 0;
+    }
+    return buckets;
+  }
+
+  bool bad = false;
+
+private:
+  template <class T>
+  span<const T> elements(span<const T> all, span_ref r) {
+    if (r.first > all.size() or r.count > all.size() - r.first) {
+      bad = true;
+      return {};
+    }
+    return all.subspan(r.first, r.count);
+  }
+
+  atom owner(uint32_t i) {
+    if (i >= owners.size()) {
+      bad = true;
+      return default_owner;
+    }
+    return owners[i];
+  }
+
+  mapped_file file;
+  snapshot_header h;
+  string_view pool;
+  vector<atom> owners;
+};
+
+pmr::memory_resource* lane(parse_arena* arena) {
+  return arena ? arena->lane() : pmr::get_default_resource();
+}
+
+// Hands what was read over to `out`, unless the snapshot turned out bad.
+template <class T>
+int finish(snapshot_reader& r, T& read, T& out) {
+  if (r.bad) {
+    errno = EBADMSG;
+    return -1;
+  }
+  out = move(read);
+  return 0;
+}
+
+} // namespace
+
+int hash_source(string_view path, snapshot_source& source) {
+  profiler::span span("hash_source");
+  mapped_file f;
+  if (f.open(path) == -1)
+    return -1;
+  content_hasher h;
+  h << f.view();
+  source = {f.view().size(), h.value()};
+  return 0;
+}
+
+int save_snapshot(string_view path, const snapshot_source& source,
+                  const vector<unit>& units) {
+  snapshot_writer w;
+  for (const auto& u : units)
+    w.add_record(unit_record{
+      u.lineno, u.mercenary, 0, w.add(u.type), w.add(u.dictionary),
+      w.add_strings(u.attributes), w.add_owners(u.owners),
+      w.add_strings(u.soldiers), w.add_strings(u.officers)});
+  return w.save(path, snapshot_kind::units, sizeof(unit_record), source, 0);
+}
+
+int save_snapshot(string_view path, const snapshot_source& source,
+                  const unordered_map<string, battle_model>& battle_models) {
+  snapshot_writer w;
+  for (const auto& [name, bm] : battle_models)
+    w.add_record(battle_model_record{
+      bm.lineno, w.add(name), w.add_textures(bm.textures),
+      w.add_textures(bm.pbr_textures), w.add_set(bm.model_paths)});
+  return w.save(path, snapshot_kind::battle_models,
+                sizeof(battle_model_record), source,
+                battle_models.bucket_count());
+}
+
+int save_snapshot(string_view path, const snapshot_source& source,
+                  const vector<strat_model_entry>& strat_model_entries) {
+  snapshot_writer w;
+  for (const auto& entry : strat_model_entries)
+    w.add_record(strat_model_entry_record{
+      entry.lineno, w.add(entry.type), w.add(entry.last_faction),
+      w.add_map(entry.models), w.add_map(entry.strat_cards)});
+  return w.save(path, snapshot_kind::strat_model_entries,
+                sizeof(strat_model_entry_record), source, 0);
+}
+
+int save_snapshot(string_view path, const snapshot_source& source,
+                  const unordered_map<string, strat_model>& strat_models) {
+  snapshot_writer w;
+  for (const auto& [name, sm] : strat_models)
+    w.add_record(strat_model_record{
+      sm.lineno, w.add(name), w.add(sm.path), w.add(sm.nv_path),
+      w.add_textures(sm.textures), w.add_textures(sm.pbr_textures)});
+  return w.save(path, snapshot_kind::strat_models, sizeof(strat_model_record),
+                source, strat_models.bucket_count());
+}
+
+int save_snapshot(string_view path, const snapshot_source& source,
+                  const vector<banner>& banners) {
+  snapshot_writer w;
+  for (const auto& ban : banners)
+    w.add_record(banner_record{ban.lineno, w.add(ban.type),
+                               w.add_set(ban.texture_paths)});
+  return w.save(path, snapshot_kind::banners, sizeof(banner_record), source,
+                0);
+}
+
+int load_snapshot(string_view path, const snapshot_source& source,
+                  parse_arena* arena, vector<unit>& out) {
+  profiler::span span("load_snapshot");
+  snapshot_reader r;
+  if (r.open(path, snapshot_kind::units, sizeof(unit_record), source) == -1)
+    return -1;
+  pmr::memory_resource* mr = lane(arena);
+  vector<unit> units;
+  units.reserve(r.section<unit_record>(record_section).size());
+  for (const auto& u : r.section<unit_record>(record_section))
+    units.push_back({u.mercenary != 0, u.lineno, r.string(u.type, mr),
+                     r.string(u.dictionary, mr), r.strings(u.attributes, mr),
+                     r.owners_of(u.owners, mr), r.strings(u.soldiers, mr),
+                     r.strings(u.officers, mr)});
+  return finish(r, units, out);
+}
+
+int load_snapshot(string_view path, const snapshot_source& source,
+                  parse_arena* arena,
+                  unordered_map<string, battle_model>& out) {
+  profiler::span span("load_snapshot");
+  snapshot_reader r;
+  if (r.open(path, snapshot_kind::battle_models, sizeof(battle_model_record),
+             source) == -1)
+    return -1;
+  pmr::memory_resource* mr = lane(arena);
+  auto records = r.section<battle_model_record>(record_section);
+  unordered_map<string, battle_model> battle_models;
+  battle_models.rehash(r.buckets_for(r.buckets(), records.size()));
+  for (auto it = records.rbegin(); it != records.rend(); ++it)
+    battle_models.emplace(
+      r.str(it->dictionary),
+      battle_model{it->lineno, r.string(it->dictionary, mr),
+                   r.textures_of(it->textures, mr),
+                   r.textures_of(it->pbr_textures, mr),
+                   r.set_of(it->model_paths, mr)});
+  return finish(r, battle_models, out);
+}
+
+int load_snapshot(string_view path, const snapshot_source& source,
+                  parse_arena* arena, vector<strat_model_entry>& out) {
+  profiler::span span("load_snapshot");
+  snapshot_reader r;
+  if (r.open(path, snapshot_kind::strat_model_entries,
+             sizeof(strat_model_entry_record), source) == -1)
+    return -1;
+  pmr::memory_resource* mr = lane(arena);
+  vector<strat_model_entry> entries;
+  entries.reserve(r.section<strat_model_entry_record>(record_section).size());
+  for (const auto& e : r.section<strat_model_entry_record>(record_section))
+    entries.push_back({e.lineno, r.string(e.type, mr),
+                       r.string(e.last_faction, mr), r.map_of(e.models, mr),
+                       r.map_of(e.strat_cards, mr)});
+  return finish(r, entries, out);
+}
+
+int load_snapshot(string_view path, const snapshot_source& source,
+                  parse_arena* arena, unordered_map<string, strat_model>& out) {
+  profiler::span span("load_snapshot");
+  snapshot_reader r;
+  if (r.open(path, snapshot_kind::strat_models, sizeof(strat_model_record),
+             source) == -1)
+    return -1;
+  pmr::memory_resource* mr = lane(arena);
+  auto records = r.section<strat_model_record>(record_section);
+  unordered_map<string, strat_model> strat_models;
+  strat_models.rehash(r.buckets_for(r.buckets(), records.size()));
+  for (auto it = records.rbegin(); it != records.rend(); ++it)
+    strat_models.emplace(
+      r.str(it->type),
+      strat_model{it->lineno, r.string(it->type, mr), r.string(it->path, mr),
+                  r.string(it->nv_path, mr), r.textures_of(it->textures, mr),
+                  r.textures_of(it->pbr_textures, mr)});
+  return finish(r, strat_models, out);
+}
+
+int load_snapshot(string_view path, const snapshot_source& source,
+                  parse_arena* arena, vector<banner>& out) {
+  profiler::span span("load_snapshot");
+  snapshot_reader r;
+  if (r.open(path, snapshot_kind::banners, sizeof(banner_record), source) ==
+      -1)
+    return -1;
+  pmr::memory_resource* mr = lane(arena);
+  vector<banner> banners;
+  banners.reserve(r.section<banner_record>(record_section).size());
+  for (const auto& b : r.section<banner_record>(record_section))
+    banners.push_back(
+      {b.lineno, r.string(b.type, mr), r.set_of(b.texture_paths, mr)});
+  return finish(r, banners, out);
+}
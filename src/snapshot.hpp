@@ -0,0 +1,69 @@
+#ifndef RRT_SNAPSHOT_HPP
+#define RRT_SNAPSHOT_HPP
+
+#include <cstdint>
+#include <string>
+#include <string_view>
+#include <unordered_map>
+#include <vector>
+
+#include "common.hpp"
+
+// Parsed definition files saved in binary, so that later runs map them and
+// read the entities straight back instead of parsing the text again. A
+// snapshot is a header, then arrays of fixed-size records that point at each
+// other and at a pool of strings by offset, so nothing in it needs fixing up
+// once mapped.
+//
+// Snapshots are only read by a build with the same snapshot version, on the
+// same kind of machine, and only if the file they were parsed from still has
+// the size and content hash they were written for, and they themselves still
+// have the content hash they were saved with. Hash maps and sets come back in
+// the order they were saved in, so that problems are reported in the same
+// order either way. What parsing logs about the file, such as models defined
+// twice, isn't logged again.
+
+// What a snapshot is checked against.
+struct snapshot_source {
+  uint64_t size;
+  uint64_t hash;
+};
+
+// Hashes the content of the definition file at `path`. Returns -1 on
+// failure, with errno set.
+int hash_source(std::string_view path, snapshot_source& source);
+
+// Write what was parsed from `source` to the snapshot at `path`, replacing
+// it. Return -1 on failure, with errno set.
+
+int save_snapshot(std::string_view path, const snapshot_source& source,
+                  const std::vector<unit>& units);
+int save_snapshot(
+  std::string_view path, const snapshot_source& source,
+  const std::unordered_map<std::string, battle_model>& battle_models);
+int save_snapshot(std::string_view path, const snapshot_source& source,
+                  const std::vector<strat_model_entry>& strat_model_entries);
+int save_snapshot(
+  std::string_view path, const snapshot_source& source,
+  const std::unordered_map<std::string, strat_model>& strat_models);
+int save_snapshot(std::string_view path, const snapshot_source& source,
+                  const std::vector<banner>& banners);
+
+// Read the snapshot at `path` into `out`, allocating from `arena` (or the
+// heap without one), if it was written for `source`. Return -1 if it wasn't,
+// or could not be read, with errno set, and leave `out` as it was then.
+
+int load_snapshot(std::string_view path, const snapshot_source& source,
+                  parse_arena* arena, std::vector<unit>& out);
+int load_snapshot(std::string_view path, const snapshot_source& source,
+                  parse_arena* arena,
+                  std::unordered_map<std::string, battle_model>& out);
+int load_snapshot(std::string_view path, const snapshot_source& source,
+                  parse_arena* arena, std::vector<strat_model_entry>& out);
+int load_snapshot(std::string_view path, const snapshot_source& source,
+                  parse_arena* arena,
+                  std::unordered_map<std::string, strat_model>& out);
+int load_snapshot(std::string_view path, const snapshot_source& source,
+                  parse_arena* arena, std::vector<banner>& out);
+
+#endif
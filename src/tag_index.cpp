@@ -0,0 +1,59 @@
+#include "tag_index.hpp"
+#include "encoding.hpp"
+
+using namespace std;
+
+int tag_index::load_export_units(string_view path) {
+  string buf;
+  if (read_text(path, buf) == -1)
+    return -1;
+  size_t lineno = 1;
+  for (size_t i = 0; i < buf.size(); ++i) {
+    if (buf[i] == '\n')
+      ++lineno;
+    else if (buf[i] == '{') {
+      size_t end = buf.find_first_of("}\n", i + 1);
+      if (end == string::npos or buf[end] != '}')
+        continue;
+      tags.emplace(buf.substr(i + 1, end - i - 1), lineno);
+      i = end;
+    }
+  }
+  return 0;
+}
+
+int tag_index::load_string_overrides(string_view path) {
+  constexpr string_view prefix = "Rome.Override.";
+  string buf;
+  if (read_text(path, buf) == -1)
+    return -1;
+  size_t lineno = 1;
+  for (size_t i = 0; i < buf.size(); ++i) {
+    if (buf[i] == '\n')
+      ++lineno;
+    else if (buf[i] == '"') {
+
+      // Skip to the closing quote, minding escaped ones inside of values.
+      size_t end = i + 1;
+      while (end < buf.size() and buf[end] != '"' and buf[end] != '\n') {
+        if (buf[end] == '\\' and end + 1 < buf.size() and buf[end + 1] != '\n')
+          ++end;
+        ++end;
+      }
+      if (end >= buf.size() or buf[end] != '"') {
+        i = end - 1;
+        continue;
+      }
+      string_view s(buf.data() + i + 1, end - i - 1);
+      if (s.starts_with(prefix))
+        tags.emplace(s.substr(prefix.size()), lineno);
+      i = end;
+    }
+  }
+  return 0;
+}
+
+size_t tag_index::lineno(string_view tag) const {
+  auto it = tags.find(tag);
+  return it == tags.end() ? 0 : it->second;
+}
@@ -0,0 +1,31 @@
+#ifndef RRT_TAG_INDEX_HPP
+#define RRT_TAG_INDEX_HPP
+
+#include <string>
+#include <string_view>
+#include <unordered_map>
+
+#include "common.hpp"
+
+// Keys defined by a text file, mapped to the line they first appear on. The
+// files may be in UTF-8 or UTF-16, see read_text().
+class tag_index {
+public:
+  // Collects every `{tag}` of an export_units.txt-style file.
+  int load_export_units(std::string_view path);
+
+  // Collects every `"Rome.Override.tag"` of an en.strings-style file.
+  int load_string_overrides(std::string_view path);
+
+  bool contains(std::string_view tag) const { return tags.contains(tag); }
+
+  // Returns the line `tag` is defined at, or 0 if it is not defined.
+  size_t lineno(std::string_view tag) const;
+
+  size_t size() const { return tags.size(); }
+
+private:
+  std::unordered_map<std::string, size_t, string_hash, std::equal_to<>> tags;
+};
+
+#endif
@@ -0,0 +1,105 @@
+#include "thread_pool.hpp"
+
+#include <algorithm>
+
+using namespace std;
+
+// The pool the current thread works for, if any, and which worker it is.
+static thread_local const thread_pool* owner = nullptr;
+static thread_local size_t worker_id;
+
+thread_pool::thread_pool(size_t nthreads) {
+  if (nthreads == 0)
+    nthreads = max(1u, thread::hardware_concurrency());
+  for (size_t i = 0; i < nthreads; ++i)
+    queues.push_back(make_unique<queue>());
+  for (size_t i = 0; i < nthreads; ++i)
+    threads.emplace_back(&thread_pool::work, this, i);
+}
+
+thread_pool::~thread_pool() {
+  {
+    lock_guard l(m);
+    stopping = true;
+  }
+  wake.notify_all();
+  for (auto& t : threads)
+    t.join();
+}
+
+void thread_pool::parallel_for(size_t n, const function<void(size_t)>& fn) {
+  if (n == 0)
+    return;
+
+  // Several chunks per worker, so that stealing can even out entries which
+  // take much longer than others.
+  size_t chunk = max<size_t>(1, n / (threads.size() * 8));
+  batch b = {(n + chunk - 1) / chunk};
+  for (size_t begin = 0, q = 0; begin < n; begin += chunk) {
+    lock_guard l(queues[q]->m);
+    queues[q]->tasks.push_back({&fn, begin, min(n, begin + chunk), &b});
+    q = (q + 1) % queues.size();
+  }
+  {
+    lock_guard l(m);
+    ++generation;
+  }
+  wake.notify_all();
+
+  // A worker calling from inside `fn` would otherwise hold up its share of
+  // the tasks, and maybe all of them.
+  if (owner == this) {
+    task t;
+    while (take(worker_id, t))
+      run(t);
+  }
+  unique_lock l(m);
+  done.wait(l, [&b]() { return b.remaining == 0; });
+}
+
+bool thread_pool::take(size_t id, task& t) {
+  {
+    lock_guard l(queues[id]->m);
+    if (not queues[id]->tasks.empty()) {
+      t = queues[id]->tasks.front();
+      queues[id]->tasks.pop_front();
+      return true;
+    }
+  }
+  for (size_t i = 1; i < queues.size(); ++i) {
+    queue& victim = *queues[(id + i) % queues.size()];
+    lock_guard l(victim.m);
+    if (not victim.tasks.empty()) {
+      t = victim.tasks.back();
+      victim.tasks.pop_back();
+      return true;
+    }
+  }
+  return false;
+}
+
+void thread_pool::run(const task& t) {
+  for (size_t i = t.begin; i < t.end; ++i)
+    (*t.fn)(i);
+  lock_guard l(m);
+  if (--t.b->remaining == 0)
+    done.notify_all();
+}
+
+void thread_pool::work(size_t id) {
+  owner = this;
+  worker_id = id;
+  size_t seen = 0;
+  for (;;) {
+    {
+      unique_lock l(m);
+      wake.wait(l, [&]() { return stopping or generation != seen; });
+      if (stopping)
+        return;
+      seen = generation;
+    }
+    task t;
+    while (take(id, t))
+      run(t);
+  }
+}
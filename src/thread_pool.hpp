@@ -0,0 +1,57 @@
+#ifndef RRT_THREAD_POOL_HPP
+#define RRT_THREAD_POOL_HPP
+
+#include <condition_variable>
+#include <deque>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+// Fixed set of worker threads, each with its own queue of index ranges. A
+// worker that runs out of work steals from the back of the other queues.
+class thread_pool {
+public:
+  explicit thread_pool(size_t nthreads);
+  ~thread_pool();
+
+  // Calls `fn(i)` for every `i` in [0, n) and blocks until all calls return.
+  // Calls from several threads at once, or from inside `fn`, are fine: a
+  // worker of the pool that has to wait runs pending tasks meanwhile.
+  void parallel_for(size_t n, const std::function<void(size_t)>& fn);
+
+  size_t size() const { return threads.size(); }
+
+private:
+  // The tasks of one parallel_for() call that have not finished yet.
+  struct batch {
+    size_t remaining;
+  };
+
+  struct task {
+    const std::function<void(size_t)>* fn;
+    size_t begin;
+    size_t end;
+    batch* b;
+  };
+
+  struct queue {
+    std::mutex m;
+    std::deque<task> tasks;
+  };
+
+  void work(size_t id);
+  bool take(size_t id, task& t);
+  void run(const task& t);
+
+  std::vector<std::thread> threads;
+  std::vector<std::unique_ptr<queue>> queues;
+  std::mutex m;
+  std::condition_variable wake;
+  std::condition_variable done;
+  size_t generation = 0;
+  bool stopping = false;
+};
+
+#endif
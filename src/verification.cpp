@@ -0,0 +1,1650 @@
+#include "verification.hpp"
+
+#include <dcc/errno.hpp>
+#include <dcc/logger.hpp>
+#include <algorithm>
+#include <atomic>
+#include <cstring>
+#include <filesystem>
+#include <future>
+#include <map>
+#include <mutex>
+#include <unordered_set>
+
+#include "cas_model.hpp"
+#include "encoding.hpp"
+#include "header_reader.hpp"
+#include "image_header.hpp"
+#include "mapped_file.hpp"
+#include "name_matcher.hpp"
+#include "profiler.hpp"
+#include "snapshot.hpp"
+
+using namespace std;
+using namespace dcc;
+namespace fs = std::filesystem;
+
+// File probes made while checking the current entry, if its result is going
+// to be cached.
+thread_local vector<verification_cache::probe>* probe_log = nullptr;
+
+// Which layer each reference was found in, for the report, when the mod is
+// layered over others.
+mutex sources_mutex;
+unordered_map<string, size_t> sources;
+
+void note_source(string_view path, int layer) {
+  if (g::assets.layer_count() == 1)
+    return;
+  lock_guard lock(sources_mutex);
+  sources.try_emplace(asset_index::normalize(path), size_t(layer));
+}
+
+bool probe(string_view path) {
+  ++prof.count.probes;
+  int layer = g::assets.layer(path);
+  bool exists = layer != -1;
+  if (probe_log != nullptr)
+    probe_log->push_back({string(path), exists});
+  if (exists)
+    note_source(path, layer);
+  return exists;
+}
+
+template <class T>
+const T& check_memo::find_or_check(slot<T>& s, const function<T()>& check) {
+  call_once(s.once, [&s, &check]() {
+    auto* log = exchange(probe_log, &s.probes);
+    s.findings = check();
+    probe_log = log;
+  });
+  if (probe_log != nullptr)
+    probe_log->insert(probe_log->end(), s.probes.begin(), s.probes.end());
+  return s.findings;
+}
+
+const check_memo::battle_model_findings&
+check_memo::battle_model(const void* bm,
+                         const function<battle_model_findings()>& check) {
+  slot<battle_model_findings>* s;
+  {
+    lock_guard lock(m);
+    auto& p = battle_models[bm];
+    if (not p)
+      p = make_unique<slot<battle_model_findings>>();
+    s = p.get();
+  }
+  return find_or_check(*s, check);
+}
+
+const vector<problem>&
+check_memo::strat_model(const void* sm, string_view owner,
+                        const function<vector<problem>()>& check) {
+  slot<vector<problem>>* s;
+  {
+    lock_guard lock(m);
+    auto& owners = strat_models[sm];
+    auto it = owners.find(owner);
+    if (it == owners.end())
+      it = owners
+             .emplace(string(owner), make_unique<slot<vector<problem>>>())
+             .first;
+    s = it->second.get();
+  }
+  return find_or_check(*s, check);
+}
+
+void check_memo::clear() {
+  lock_guard lock(m);
+  battle_models.clear();
+  strat_models.clear();
+}
+
+string locate(string_view path) {
+  int layer = g::assets.layer(path);
+  if (layer == -1)
+    return string(path);
+  note_source(path, layer);
+  return g::assets.resolve(path);
+}
+
+string cache_path(string_view name) {
+  return fmt::format("{}/{}.cache", g::cache_dir, name);
+}
+
+// Caches stay loaded for the whole run, so that --watch reuses the results of
+// its own earlier passes.
+verification_cache& cache_for(string_view name) {
+  auto& cache = g::caches[string(name)];
+  if (not cache) {
+    cache = make_unique<verification_cache>();
+    if (g::use_cache)
+      cache->load(cache_path(name));
+  }
+  return *cache;
+}
+
+// Every path the existence of which a cached result depended on, normalized,
+// and the hashes of the results they were taken from. Stale paths are never
+// dropped, which only makes changes to them look relevant when they aren't.
+mutex probed_mutex;
+unordered_set<uint64_t> probed_results;
+unordered_set<string> probed_paths;
+
+void note_probes(uint64_t hash,
+                 const vector<verification_cache::probe>& probes) {
+  lock_guard lock(probed_mutex);
+  if (probed_results.insert(hash).second)
+    for (const auto& p : probes)
+      probed_paths.insert(asset_index::normalize(p.path));
+}
+
+bool probed(string_view path, bool directory) {
+  string n = asset_index::normalize(path);
+  lock_guard lock(probed_mutex);
+  if (probed_paths.contains(n))
+    return true;
+  if (not directory)
+    return false;
+  n += '/';
+  return any_of(probed_paths.begin(), probed_paths.end(),
+                [&n](const string& p) { return p.starts_with(n); });
+}
+
+// Runs `check` on every entry, spread over the thread pool if there is one.
+// Problems are kept per entry, so they are reported in the same order no
+// matter how many threads were used.
+//
+// With --cache, --watch or --serve, `hash` of an entry is looked up in the
+// `cache_name` cache first, and the entry is only checked if it or its probes
+// changed.
+template <class T, class F, class H>
+vector<vector<problem>> check_all(const vector<T>& entries, F check, H hash,
+                                  string_view cache_name) {
+  profiler::span span(fmt::format("check_{}", cache_name));
+  vector<vector<problem>> problems(entries.size());
+  verification_cache* cache = nullptr;
+  if (g::use_cache or g::watch or g::serve)
+    cache = &cache_for(cache_name);
+  atomic<size_t> reused = 0;
+  auto run = [&](size_t i) {
+    profiler::span entry(cache_name, true);
+    if (not cache) {
+      problems[i] = check(entries[i]);
+      return;
+    }
+    uint64_t h = hash(entries[i]);
+    auto unchanged = [](const verification_cache::probe& p) {
+      int layer = g::assets.layer(p.path);
+      if (layer != -1)
+        note_source(p.path, layer);
+      return (layer != -1) == p.exists;
+    };
+    const verification_cache::result* r = cache->find(h);
+    if (r != nullptr and
+        all_of(r->probes.begin(), r->probes.end(), unchanged)) {
+      problems[i] = r->problems;
+      note_probes(h, r->probes);
+      cache->store(h, *r);
+      ++reused;
+      ++prof.count.cache_hits;
+      return;
+    }
+    vector<verification_cache::probe> probes;
+    probe_log = &probes;
+    problems[i] = check(entries[i]);
+    probe_log = nullptr;
+    note_probes(h, probes);
+    cache->store(h, {move(probes), problems[i]});
+  };
+  if (g::pool)
+    g::pool->parallel_for(entries.size(), run);
+  else
+    for (size_t i = 0; i < entries.size(); ++i)
+      run(i);
+  if (cache and not g::quiet) {
+    dcc_loginf("Reused {} of {} cached results.", sgr::semiunique(reused),
+               sgr::semiunique(entries.size()));
+  }
+  if (g::use_cache) {
+    error_code ec;
+    fs::create_directories(g::cache_dir, ec);
+    if (cache->save(cache_path(cache_name)) == -1)
+      dcc_logerr("Could not save {}: {}.", sgr::file(cache_path(cache_name)),
+                 errmsg());
+  }
+  if (cache)
+    cache->advance();
+  return problems;
+}
+
+// What an entry's verification depends on besides its file probes goes into
+// its hash. The flags decide which checks are made, so they always do.
+content_hasher flags_hasher() {
+  content_hasher h;
+  h << uint64_t(g::check_all_factions)
+    << uint64_t(g::check_all_referenced_paths) << uint64_t(g::ignore_slave);
+  return h;
+}
+
+template <class Texture>
+void hash_textures(content_hasher& h, const texture_map<Texture>& textures) {
+  h << textures.size();
+  for (const auto& [owner, t] : textures)
+    h << atoms.name(owner) << t.lineno << t.path;
+}
+
+uint64_t hash_banner(const banner& ban) {
+  content_hasher h;
+  h << ban.lineno << ban.type << ban.texture_paths.size();
+  for (const auto& path : ban.texture_paths)
+    h << path;
+  return h.value();
+}
+
+uint64_t
+hash_character(const strat_model_entry& entry,
+               const unordered_map<string, strat_model>& strat_models) {
+  content_hasher h = flags_hasher();
+  h << entry.lineno << entry.type << entry.models.size();
+  for (const auto& [owner, modelstr] : entry.models) {
+    h << owner << modelstr;
+    auto it = strat_models.find(string(modelstr));
+    if (it == strat_models.end()) {
+      h << uint64_t(0);
+      continue;
+    }
+    const strat_model& sm = it->second;
+    h << sm.lineno << sm.type << sm.path << sm.nv_path;
+    hash_textures(h, sm.textures);
+    hash_textures(h, sm.pbr_textures);
+  }
+  return h.value();
+}
+
+template <class U, class Key, class BM>
+uint64_t hash_unit(const U& u, const unordered_map<Key, BM>& battle_models,
+                   const tag_index& export_units, const tag_index& en_strings,
+                   const unit_rosters& rosters) {
+  content_hasher h = flags_hasher();
+  h << u.lineno << u.dictionary << uint64_t(u.mercenary) << u.owners.size();
+  h << uint64_t(rosters.factions.empty());
+  for (atom owner : u.owners) {
+    string_view name = atoms.name(owner);
+    h << name << uint64_t(rosters.factions.contains(name));
+  }
+  h << u.type << u.attributes.size() << uint64_t(rosters.recruited.empty())
+    << uint64_t(rosters.recruited.contains(u.type));
+  for (const auto& attr : u.attributes)
+    h << attr;
+  for (const auto* troops : {&u.soldiers, &u.officers}) {
+    h << troops->size();
+    for (const auto& soldier : *troops) {
+      h << soldier;
+      auto it = battle_models.find(Key(soldier));
+      if (it == battle_models.end()) {
+        h << uint64_t(0);
+        continue;
+      }
+      const BM& bm = it->second;
+      h << bm.lineno << bm.dictionary << bm.model_paths.size();
+      for (const auto& path : bm.model_paths)
+        h << path;
+      hash_textures(h, bm.textures);
+      hash_textures(h, bm.pbr_textures);
+    }
+  }
+  for (string_view suffix : {"", "_descr", "_descr_short"}) {
+    string tag = fmt::format("{}{}", u.dictionary, suffix);
+    h << export_units.lineno(tag) << en_strings.lineno(tag);
+  }
+  return h.value();
+}
+
+// Adds the problems of an entry to g::problems, see write_report().
+void add_problems(string_view name, string_view fname, size_t lineno,
+                  vector<problem> problems) {
+  if (problems.empty())
+    return;
+  ++g::problem_count;
+  prof.count.problems += problems.size();
+  if (not g::quiet)
+    g::problems.add(name, fname, lineno, move(problems));
+}
+
+vector<problem> check_banner(const banner& ban) {
+  vector<problem> problems;
+  for (const auto& texpath : ban.texture_paths) {
+    if (not probe(texpath))
+      problems.push_back(
+        {.kind = "missing-file",
+         .message =
+           fmt::format("Texture {} missing from path.", sgr::file(texpath)),
+         .path = string(texpath)});
+  }
+  return problems;
+}
+
+size_t verify_banners(const vector<banner>& banners) {
+  profiler::span span("verify_banners");
+  if (not g::quiet)
+    dcc_logmsg("Verifying banners...");
+  vector<vector<problem>> problems =
+    check_all(banners, check_banner, hash_banner, "banners");
+  profiler::span reporting("report_banners");
+  size_t flawed = 0;
+  for (size_t i = 0; i < banners.size(); ++i) {
+    flawed += not problems[i].empty();
+    add_problems(banners[i].type, g::db_filename, banners[i].lineno,
+                 move(problems[i]));
+  }
+  if (flawed == 0 and not g::quiet)
+    dcc_logmsg("All {} banners are valid.", sgr::semiunique(banners.size()));
+  return flawed;
+}
+
+// What is wrong with the strat model `sm`, known as `modelstr`, for `owner`,
+// whichever character uses it.
+static vector<problem> check_strat_model(string_view modelstr,
+                                         string_view owner,
+                                         const strat_model& sm) {
+  vector<problem> problems;
+  bool got_default_pbr_tex = true;
+  bool got_default_tex = true;
+  atom owner_id = atoms.find(owner);
+  auto ddspath = [](const string_view tpath) {
+    return fmt::format("{}.dds", tpath);
+  };
+
+  // Problems of the model, at the line `lineno` of descr_model_strat.txt.
+  auto model_problem = [&problems](string kind, string message, size_t lineno,
+                                   string path = "", string_view faction = "") {
+    problems.push_back({move(kind), move(message), move(path),
+                        string(faction), string(g::dms_filename), lineno});
+  };
+
+  // PBR textures
+  if (not sm.pbr_textures.contains(default_owner)) {
+    model_problem(
+      "missing-default-pbr-texture",
+      fmt::format(
+        "Missing default pbr_texture for {} at {}.",
+        sgr::semiunique(modelstr),
+        sgr::file(fmt::format("{}:{}", g::dms_filename, sm.lineno))),
+      sm.lineno);
+    got_default_pbr_tex = false;
+  }
+  else if (not probe(ddspath(sm.pbr_textures.at(default_owner).path))) {
+    const texture& t = sm.pbr_textures.at(default_owner);
+    model_problem(
+      "missing-file",
+      fmt::format(
+        "Default texture {} for {} is missing from path at {}.",
+        sgr::file(ddspath(t.path)), sgr::semiunique(modelstr),
+        sgr::file(fmt::format("{}:{}", g::dms_filename, t.lineno))),
+      t.lineno, ddspath(t.path));
+    got_default_pbr_tex = false;
+  }
+  if (not sm.pbr_textures.contains(owner_id)) {
+    if (not got_default_pbr_tex or g::check_all_factions) {
+      model_problem(
+        "missing-faction-pbr-texture",
+        fmt::format(
+          "Missing {} pbr_texture at for {} at {}.", sgr::unique(owner),
+          sgr::semiunique(modelstr),
+          sgr::file(fmt::format("{}:{}", g::dms_filename, sm.lineno))),
+        sm.lineno, "", owner);
+    }
+  }
+  else if (not got_default_pbr_tex or g::check_all_referenced_paths) {
+    const texture& t = sm.textures.at(owner_id);
+    if (not probe(ddspath(t.path))) {
+      model_problem(
+        "missing-file",
+        fmt::format(
+          "Texture {} for {} for {} missing from path at {}.",
+          sgr::file(ddspath(t.path)), sgr::semiunique(modelstr),
+          sgr::unique(owner),
+          sgr::file(fmt::format("{}:{}", g::dms_filename, t.lineno))),
+        t.lineno, ddspath(t.path), owner);
+    }
+  }
+
+  // Regular textures
+  if (not sm.textures.contains(default_owner)) {
+    model_problem(
+      "missing-default-texture",
+      fmt::format(
+        "Missing default texture for {} at {}.", sgr::semiunique(modelstr),
+        sgr::file(fmt::format("{}:{}", g::dms_filename, sm.lineno))),
+      sm.lineno);
+    got_default_tex = false;
+  }
+  else if (not probe(ddspath(sm.textures.at(default_owner).path))) {
+    const texture& t = sm.textures.at(default_owner);
+    model_problem(
+      "missing-file",
+      fmt::format(
+        "Default texture {} for {} is missing from path at {}.",
+        sgr::file(ddspath(t.path)), sgr::semiunique(modelstr),
+        sgr::file(fmt::format("{}:{}", g::dms_filename, t.lineno))),
+      t.lineno, ddspath(t.path));
+    got_default_tex = false;
+  }
+  if (not sm.textures.contains(owner_id)) {
+    if (not got_default_tex or g::check_all_factions) {
+      model_problem(
+        "missing-faction-texture",
+        fmt::format(
+          "Missing {} texture at for {} at {}.", sgr::unique(owner),
+          sgr::semiunique(modelstr),
+          sgr::file(fmt::format("{}:{}", g::dms_filename, sm.lineno))),
+        sm.lineno, "", owner);
+    }
+  }
+  else if (not got_default_tex or g::check_all_referenced_paths) {
+    const texture& t = sm.textures.at(owner_id);
+    if (not probe(ddspath(t.path))) {
+      model_problem(
+        "missing-file",
+        fmt::format(
+          "Texture {} for {} for {} missing from path at {}.",
+          sgr::file(ddspath(t.path)), sgr::semiunique(modelstr),
+          sgr::unique(owner),
+          sgr::file(fmt::format("{}:{}", g::dms_filename, t.lineno))),
+        t.lineno, ddspath(t.path), owner);
+    }
+  }
+
+  // Models
+  if (sm.path.empty()) {
+    model_problem(
+      "missing-model-flexi",
+      fmt::format(
+        "Missing model_flexi for {} at {}.", sgr::semiunique(modelstr),
+        sgr::file(fmt::format("{}:{}", g::dms_filename, sm.lineno))),
+      sm.lineno);
+  }
+  else if (not probe(sm.path)) {
+    model_problem(
+      "missing-file",
+      fmt::format(
+        "Model {} is missing from path at {}.", sgr::file(sm.path),
+        sgr::file(fmt::format("{}:{}", g::dms_filename, sm.lineno))),
+      sm.lineno, string(sm.path));
+  }
+  if (sm.nv_path.empty()) {
+    model_problem(
+      "missing-no-variation-model-flexi",
+      fmt::format(
+        "Missing no_variation model_flexi for {} at {}.",
+        sgr::unique(modelstr),
+        sgr::file(fmt::format("{}:{}", g::dms_filename, sm.lineno))),
+      sm.lineno);
+  }
+  else if (sm.nv_path != sm.path and not probe(sm.nv_path)) {
+    model_problem(
+      "missing-file",
+      fmt::format(
+        "Model {} is missing from path at {}.", sgr::file(sm.nv_path),
+        sgr::file(fmt::format("{}:{}", g::dms_filename, sm.lineno))),
+      sm.lineno, string(sm.nv_path));
+  }
+  return problems;
+}
+
+vector<problem>
+check_character(const strat_model_entry& entry,
+                const unordered_map<string, strat_model>& strat_models,
+                check_memo& memo) {
+  unordered_set<string> handled_models;
+  vector<problem> problems;
+
+  // // strat_cards
+  // for (const auto& [owner, scstr] : entry.strat_cards) {
+  //   if (owner == "slave" and g::ignore_slave)
+  //     continue;
+  //   if (not probe(scstr)) {
+  //     problems.push_back(
+  //       fmt::format("strat_card {} missing from path for {}.",
+  //                   sgr::file(scstr), sgr::unique(owner)));
+  //   }
+  // }
+  for (const auto& [owner, modelstr] : entry.models) {
+    if (owner == "slave" and g::ignore_slave)
+      continue;
+    string model(modelstr);
+    if (not strat_models.contains(model)) {
+      problems.push_back({.kind = "missing-strat-model",
+                          .message = fmt::format("No entry for {} found in {}.",
+                                                 sgr::semiunique(modelstr),
+                                                 sgr::file(g::dms_filename)),
+                          .faction = string(owner),
+                          .file = string(g::dms_filename)});
+    }
+    else {
+      if (handled_models.contains(model))
+        continue;
+      handled_models.insert(model);
+
+      const auto& sm = strat_models.at(model);
+      const auto& found = memo.strat_model(&sm, owner, [&]() {
+        return check_strat_model(modelstr, owner, sm);
+      });
+      problems.insert(problems.end(), found.begin(), found.end());
+    }
+  }
+  return problems;
+}
+
+size_t verify_strat_models(
+  const vector<strat_model_entry>& strat_model_entries,
+  const unordered_map<string, strat_model>& strat_models) {
+  profiler::span span("verify_strat_models");
+  if (not g::quiet)
+    dcc_logmsg("Verifying characters...");
+  check_memo memo;
+  vector<vector<problem>> problems = check_all(
+    strat_model_entries,
+    [&](const strat_model_entry& entry) {
+      return check_character(entry, strat_models, memo);
+    },
+    [&](const strat_model_entry& entry) {
+      return hash_character(entry, strat_models);
+    },
+    "characters");
+  profiler::span reporting("report_strat_models");
+  size_t flawed = 0;
+  for (size_t i = 0; i < strat_model_entries.size(); ++i) {
+    flawed += not problems[i].empty();
+    add_problems(strat_model_entries[i].type, g::dc_filename,
+                 strat_model_entries[i].lineno, move(problems[i]));
+  }
+  if (flawed == 0 and not g::quiet)
+    dcc_logmsg("All {} character models are valid.",
+               sgr::semiunique(strat_models.size()));
+  return flawed;
+}
+
+// What is wrong with the battle model `bm`, known as `soldier`, whichever
+// unit uses it. Works on both the owning and the mapped records.
+template <class BM>
+check_memo::battle_model_findings check_battle_model(string_view soldier,
+                                                     const BM& bm) {
+  check_memo::battle_model_findings found;
+  auto model_problem = [](vector<problem>& to, string kind, string message,
+                          size_t lineno, string path = "",
+                          string faction = "") {
+    to.push_back({move(kind), move(message), move(path), move(faction),
+                  string(g::dmb_filename), lineno});
+  };
+
+  // Verify models
+  for (const auto& mpath : bm.model_paths) {
+    if (not probe(mpath)) {
+      model_problem(
+        found.model, "missing-file",
+        fmt::format(
+          "Model {} missing from path for {} at {}.", sgr::file(mpath),
+          sgr::semiunique(soldier),
+          sgr::file(fmt::format("{}:{}", g::dmb_filename, bm.lineno))),
+        bm.lineno, string(mpath));
+    }
+  }
+
+  // Verify textures
+  if (not bm.pbr_textures.contains(default_owner)) {
+    model_problem(
+      found.model, "missing-default-pbr-texture",
+      fmt::format("Missing default pbr_texture for {} at {}.",
+                  sgr::semiunique(soldier),
+                  sgr::file(fmt::format("{}:{}", g::dmb_filename, bm.lineno))),
+      bm.lineno);
+  }
+  if (not bm.textures.contains(default_owner)) {
+    model_problem(
+      found.model, "missing-default-texture",
+      fmt::format("Missing default texture for {} at {}.",
+                  sgr::semiunique(soldier),
+                  sgr::file(fmt::format("{}:{}", g::dmb_filename, bm.lineno))),
+      bm.lineno);
+  }
+  auto check_disk_for_textures = [&](const auto& textures) {
+    for (const auto& [owner, texture] : textures) {
+      if (not g::check_all_referenced_paths and owner != default_owner)
+        continue;
+
+      // For some reason, the game's files reference by one extension,
+      // while the files exist on disk by another.
+      string actual_path = fmt::format("{}.dds", texture.path);
+      if (not probe(actual_path)) {
+        model_problem(
+          found.textures, "missing-file",
+          fmt::format("Texture {} missing from path for {} at {}.",
+                      sgr::file(actual_path), sgr::semiunique(soldier),
+                      sgr::file(fmt::format("{}:{}", g::dmb_filename,
+                                            texture.lineno))),
+          texture.lineno, actual_path,
+          owner == default_owner ? "" : string(atoms.name(owner)));
+      }
+    }
+  };
+  check_disk_for_textures(bm.pbr_textures);
+  check_disk_for_textures(bm.textures);
+  return found;
+}
+
+// Works on both the owning and the mapped records.
+template <class U, class Key, class BM>
+vector<problem> check_unit(const U& u,
+                           const unordered_map<Key, BM>& battle_models,
+                           const tag_index& export_units,
+                           const tag_index& en_strings,
+                           const unit_rosters& rosters, check_memo& memo) {
+  vector<problem> problems;
+  vector<string> str_entries = {string(u.dictionary),
+                                fmt::format("{}_descr", u.dictionary),
+                                fmt::format("{}_descr_short", u.dictionary)};
+
+  // Points a missing description tag at the unit's name tag, if that one is
+  // there.
+  auto missing_tag = [&u](const tag_index& tags, string_view fname,
+                          string tag) {
+    size_t lineno = tags.lineno(u.dictionary);
+    string message =
+      lineno != 0
+        ? fmt::format("{} missing from {}, expected next to {} at {}.",
+                      sgr::problem(tag), sgr::file(fname),
+                      sgr::semiunique(u.dictionary),
+                      sgr::file(fmt::format("{}:{}", fname, lineno)))
+        : fmt::format("{} missing from {}.", sgr::problem(tag),
+                      sgr::file(fname));
+    return problem{.kind = "missing-tag",
+                   .message = move(message),
+                   .file = string(fname),
+                   .lineno = lineno};
+  };
+
+  // Verify export_units.txt
+  for (const auto& s : str_entries) {
+    if (not export_units.contains(s))
+      problems.push_back(
+        missing_tag(export_units, g::eu_filename, fmt::format("{{{}}}", s)));
+  }
+
+  // Verify en.strings
+  for (const auto& s : str_entries) {
+    if (not en_strings.contains(s))
+      problems.push_back(missing_tag(en_strings, g::en_strs_filename,
+                                     fmt::format("Rome.Override.{}", s)));
+  }
+
+  // Verify unit cards
+  auto missing_card = [&problems](string card, string_view dir, string path,
+                                  string_view faction) {
+    problems.push_back({.kind = "missing-unit-card",
+                        .message = fmt::format("{} missing from {}.",
+                                               sgr::problem(card),
+                                               sgr::file(dir)),
+                        .path = move(path),
+                        .faction = string(faction)});
+  };
+  if (u.mercenary) {
+
+    // This is a mercenary unit, so we should verify it has unit cards for
+    // the mercenary faction only.
+    string unit_card = fmt::format("#{}.tga", u.dictionary);
+    string path = fmt::format("data/ui/units/mercs/{}", unit_card);
+    if (not probe(path))
+      missing_card(unit_card, "ui/units/mercs", path, "");
+    unit_card = fmt::format("{}_info.tga", u.dictionary);
+    path = fmt::format("data/ui/unit_info/merc/{}", unit_card);
+    if (not probe(path))
+      missing_card(unit_card, "data/ui/unit_info/merc", path, "");
+  }
+  else {
+    if (u.owners.empty())
+      problems.push_back(
+        {.kind = "no-owners", .message = "This unit has no owners."});
+    for (atom owner_id : u.owners) {
+      if (g::ignore_slave and owner_id == slave_owner)
+        continue;
+
+      string_view owner = atoms.name(owner_id);
+      string unit_card = fmt::format("#{}.tga", u.dictionary);
+      string dir = fmt::format("data/ui/units/{}", owner);
+      string path = fmt::format("{}/{}", dir, unit_card);
+      if (not probe(path))
+        missing_card(unit_card, dir, path, owner);
+      unit_card = fmt::format("{}_info.tga", u.dictionary);
+      dir = fmt::format("data/ui/unit_info/{}", owner);
+      path = fmt::format("{}/{}", dir, unit_card);
+      if (not probe(path))
+        missing_card(unit_card, dir, path, owner);
+    }
+  }
+
+  // Verify owners and recruitment
+  if (not rosters.factions.empty()) {
+    for (atom owner_id : u.owners) {
+      if (g::ignore_slave and owner_id == slave_owner)
+        continue;
+      string_view owner = atoms.name(owner_id);
+      if (not rosters.factions.contains(owner))
+        problems.push_back(
+          {.kind = "unknown-owner",
+           .message = fmt::format("Owner {} missing from {}.",
+                                  sgr::problem(owner),
+                                  sgr::file(g::dsf_filename)),
+           .faction = string(owner)});
+    }
+  }
+
+  // Mercenaries are hired and generals' bodyguards come with them, so
+  // neither is recruited in any building.
+  auto general = [](const auto& attr) {
+    return attr.starts_with("general_unit");
+  };
+  if (not rosters.recruited.empty() and not u.mercenary and
+      none_of(u.attributes.begin(), u.attributes.end(), general) and
+      not rosters.recruited.contains(u.type))
+    problems.push_back({.kind = "not-recruited",
+                        .message = fmt::format("No building in {} recruits {}.",
+                                               sgr::file(g::edb_filename),
+                                               sgr::problem(u.type)),
+                        .file = string(g::edb_filename)});
+
+  // Problems of a battle model, at the line `lineno` of
+  // descr_model_battle.txt.
+  auto model_problem = [&problems](string kind, string message, size_t lineno,
+                                   string path = "", string faction = "") {
+    problems.push_back({move(kind), move(message), move(path), move(faction),
+                        string(g::dmb_filename), lineno});
+  };
+
+  unordered_set<string> missing_textures;
+  unordered_set<Key> handled_troops;
+  auto verify_bm = [&](const auto& troops) {
+    for (const auto& soldier : troops) {
+      const Key key(soldier);
+      if (handled_troops.contains(key))
+        continue;
+      handled_troops.insert(key);
+      if (not battle_models.contains(key)) {
+        problems.push_back({.kind = "missing-battle-model",
+                            .message = fmt::format("{} missing from {}.",
+                                                   sgr::problem(soldier),
+                                                   sgr::file(g::dmb_filename)),
+                            .file = string(g::dmb_filename)});
+        continue;
+      }
+      const BM& bm = battle_models.at(key);
+      const auto& found = memo.battle_model(
+        &bm, [&]() { return check_battle_model(soldier, bm); });
+      problems.insert(problems.end(), found.model.begin(), found.model.end());
+      if (g::check_all_factions) {
+        for (atom owner : u.owners) {
+          if (g::ignore_slave and owner == slave_owner)
+            continue;
+          string faction(atoms.name(owner));
+          if (not bm.pbr_textures.contains(owner))
+            model_problem(
+              "missing-faction-pbr-texture",
+              fmt::format(
+                "Missing pbr_texture for {} for {} at {}.",
+                sgr::semiunique(soldier), sgr::unique(faction),
+                sgr::file(fmt::format("{}:{}", g::dmb_filename, bm.lineno))),
+              bm.lineno, "", faction);
+          if (not bm.textures.contains(owner))
+            model_problem(
+              "missing-faction-texture",
+              fmt::format(
+                "Missing texture for {} for {} at {}.",
+                sgr::semiunique(soldier), sgr::unique(faction),
+                sgr::file(fmt::format("{}:{}", g::dmb_filename, bm.lineno))),
+              bm.lineno, "", faction);
+        }
+      }
+
+      // A texture shared by the models of a unit is only reported once.
+      for (const auto& p : found.textures)
+        if (missing_textures.insert(p.path).second)
+          problems.push_back(p);
+    }
+  };
+  verify_bm(u.soldiers);
+  verify_bm(u.officers);
+  return problems;
+}
+
+tag_index read_export_units() {
+  profiler::span span("read_export_units");
+  tag_index export_units;
+  if (export_units.load_export_units(locate(g::eu_filename)) == -1) {
+    dcc_logerr("Could not read {}: {}", sgr::file(g::eu_filename), errmsg());
+    exit(-1);
+  }
+  prof.count_parsed(g::eu_filename, export_units.size());
+  return export_units;
+}
+
+tag_index read_en_strings() {
+  profiler::span span("read_en_strings");
+  tag_index en_strings;
+  if (en_strings.load_string_overrides(locate(g::en_strs_filename)) == -1) {
+    dcc_logerr("Could not read {}: {}.", sgr::file(g::en_strs_filename),
+               errmsg());
+    exit(-1);
+  }
+  prof.count_parsed(g::en_strs_filename, en_strings.size());
+  return en_strings;
+}
+
+vector<vector<problem>> check_units(const mod_state& st,
+                                    const unit_rosters& rosters) {
+  check_memo memo;
+  return check_all(
+    st.units,
+    [&](const unit& u) {
+      return check_unit(u, st.battle_models, st.export_units, st.en_strings,
+                        rosters, memo);
+    },
+    [&](const unit& u) {
+      return hash_unit(u, st.battle_models, st.export_units, st.en_strings,
+                       rosters);
+    },
+    "units");
+}
+
+vector<vector<problem>> check_characters(const mod_state& st) {
+  check_memo memo;
+  return check_all(
+    st.strat_model_entries,
+    [&](const strat_model_entry& entry) {
+      return check_character(entry, st.strat_models, memo);
+    },
+    [&](const strat_model_entry& entry) {
+      return hash_character(entry, st.strat_models);
+    },
+    "characters");
+}
+
+vector<vector<problem>> check_banners(const mod_state& st) {
+  return check_all(st.banners, check_banner, hash_banner, "banners");
+}
+
+template <class U, class Key, class BM>
+size_t verify_units(const vector<U>& units,
+                    const unordered_map<Key, BM>& battle_models,
+                    const tag_index& export_units,
+                    const tag_index& en_strings,
+                    const unit_rosters& rosters) {
+  profiler::span span("verify_units");
+  if (not g::quiet)
+    dcc_logmsg("Verifying units...");
+  check_memo memo;
+  vector<vector<problem>> problems = check_all(
+    units,
+    [&](const U& u) {
+      return check_unit(u, battle_models, export_units, en_strings, rosters,
+                        memo);
+    },
+    [&](const U& u) {
+      return hash_unit(u, battle_models, export_units, en_strings, rosters);
+    },
+    "units");
+  profiler::span reporting("report_units");
+  size_t flawed = 0;
+  for (size_t i = 0; i < units.size(); ++i) {
+    flawed += not problems[i].empty();
+    add_problems(units[i].dictionary, g::edu_filename, units[i].lineno,
+                 move(problems[i]));
+  }
+  if (flawed == 0 and not g::quiet)
+    dcc_logmsg("All {} units are valid.", sgr::semiunique(units.size()));
+  return flawed;
+}
+
+// An asset, and the first definition to reference it.
+struct asset_reference {
+  string path;
+  string_view fname;
+  size_t lineno;
+};
+
+// Models come out of hash maps, so references to what they use are put in
+// the order of the definitions.
+void sort_references(vector<asset_reference>& refs) {
+  sort(refs.begin(), refs.end(), [](const auto& a, const auto& b) {
+    return tie(a.fname, a.lineno, a.path) < tie(b.fname, b.lineno, b.path);
+  });
+}
+
+// Every existing image the definitions reference, whatever the flags.
+vector<asset_reference> referenced_images(const mod_state& st) {
+  vector<asset_reference> refs;
+  unordered_set<string> seen;
+  auto add = [&refs, &seen](string path, string_view fname, size_t lineno) {
+    string n = asset_index::normalize(path);
+    if (not g::assets.exists(n) or not seen.insert(move(n)).second)
+      return;
+    refs.push_back({move(path), fname, lineno});
+  };
+  for (const auto& u : st.units) {
+    if (u.mercenary) {
+      add(fmt::format("data/ui/units/mercs/#{}.tga", u.dictionary),
+          g::edu_filename, u.lineno);
+      add(fmt::format("data/ui/unit_info/merc/{}_info.tga", u.dictionary),
+          g::edu_filename, u.lineno);
+      continue;
+    }
+    for (atom owner_id : u.owners) {
+      string_view owner = atoms.name(owner_id);
+      add(fmt::format("data/ui/units/{}/#{}.tga", owner, u.dictionary),
+          g::edu_filename, u.lineno);
+      add(fmt::format("data/ui/unit_info/{}/{}_info.tga", owner, u.dictionary),
+          g::edu_filename, u.lineno);
+    }
+  }
+  auto add_textures = [&add](const auto& textures, string_view fname) {
+    for (const auto& [owner, t] : textures)
+      add(fmt::format("{}.dds", t.path), fname, t.lineno);
+  };
+  for (const auto& [name, bm] : st.battle_models) {
+    add_textures(bm.textures, g::dmb_filename);
+    add_textures(bm.pbr_textures, g::dmb_filename);
+  }
+  for (const auto& [name, sm] : st.strat_models) {
+    add_textures(sm.textures, g::dms_filename);
+    add_textures(sm.pbr_textures, g::dms_filename);
+  }
+  for (const auto& ban : st.banners)
+    for (const auto& path : ban.texture_paths)
+      add(string(path), g::db_filename, ban.lineno);
+
+  sort_references(refs);
+  return refs;
+}
+
+size_t validate_assets(const mod_state& st) {
+  profiler::span span("validate_assets");
+  vector<asset_reference> refs = referenced_images(st);
+  if (not g::quiet)
+    dcc_logmsg("Validating {} textures and unit cards...",
+               sgr::semiunique(refs.size()));
+  vector<header_read> reads;
+  reads.reserve(refs.size());
+  for (const auto& ref : refs)
+    reads.push_back({.path = locate(ref.path)});
+  {
+    profiler::span reading("read_headers");
+    read_headers(reads, image_header_size, g::pool.get());
+  }
+
+  profiler::span reporting("report_assets");
+  struct format_total {
+    size_t files = 0;
+    uint64_t bytes = 0;
+  };
+  map<string, format_total> totals;
+  size_t flawed = 0;
+  for (size_t i = 0; i < refs.size(); ++i) {
+    const header_read& r = reads[i];
+    bool dds = asset_index::normalize(r.path).ends_with(".dds");
+    vector<problem> problems;
+    image_info info;
+    string what;
+    if (r.error != 0)
+      problems.push_back({.kind = "unreadable-file",
+                          .message = fmt::format("{} could not be read: {}.",
+                                                 sgr::file(r.path),
+                                                 strerror(r.error)),
+                          .path = r.path});
+    else if (what = dds ? inspect_dds(r.bytes, r.size, info)
+                        : inspect_tga(r.bytes, r.size, info);
+             not what.empty())
+      problems.push_back(
+        {.kind = dds ? "invalid-dds" : "invalid-tga",
+         .message = fmt::format("{} is not a valid {}: {}.", sgr::file(r.path),
+                                dds ? "DDS texture" : "TGA image",
+                                sgr::problem(what)),
+         .path = r.path});
+    else {
+      format_total& t = totals[fmt::format("{} {}", dds ? "DDS" : "TGA",
+                                           info.format)];
+      ++t.files;
+      t.bytes += r.size;
+    }
+    flawed += not problems.empty();
+    add_problems(refs[i].path, refs[i].fname, refs[i].lineno,
+                 move(problems));
+  }
+  if (g::quiet)
+    return flawed;
+  if (flawed == 0)
+    dcc_logmsg("All {} textures and unit cards are valid.",
+               sgr::semiunique(refs.size()));
+  for (const auto& [format, t] : totals)
+    dcc_loginf("  {:<28} {} files, {:.1f} MiB.", format,
+               sgr::semiunique(t.files), t.bytes / 1048576.0);
+  return flawed;
+}
+
+// Every existing model the definitions reference, each once.
+vector<asset_reference> referenced_models(const mod_state& st) {
+  vector<asset_reference> refs;
+  unordered_set<string> seen;
+  auto add = [&refs, &seen](string_view path, string_view fname,
+                            size_t lineno) {
+    string n = asset_index::normalize(path);
+    if (path.empty() or not g::assets.exists(n) or
+        not seen.insert(move(n)).second)
+      return;
+    refs.push_back({string(path), fname, lineno});
+  };
+  for (const auto& [name, bm] : st.battle_models)
+    for (const auto& path : bm.model_paths)
+      add(path, g::dmb_filename, bm.lineno);
+  for (const auto& [name, sm] : st.strat_models) {
+    add(sm.path, g::dms_filename, sm.lineno);
+    add(sm.nv_path, g::dms_filename, sm.lineno);
+  }
+  sort_references(refs);
+  return refs;
+}
+
+// Skeletons declared in descr_skeleton.txt, none if the mod has no such
+// file.
+unordered_set<string> read_skeletons() {
+  unordered_set<string> skeletons;
+  string text;
+  if (not g::assets.exists(g::ds_filename) or
+      read_text(locate(g::ds_filename), text) == -1)
+    return skeletons;
+  for (size_t begin = 0; begin < text.size();) {
+    size_t end = min(text.find('\n', begin), text.size());
+    string_view line = string_view(text).substr(begin, end - begin);
+    begin = end + 1;
+    size_t first = line.find_first_not_of(" \t");
+    if (first == string_view::npos or line.substr(first, 4) != "type")
+      continue;
+    line.remove_prefix(first + 4);
+    size_t name = line.find_first_not_of(" \t");
+    if (name == 0 or name == string_view::npos)
+      continue;
+    line.remove_prefix(name);
+    skeletons.emplace(line.substr(0, line.find_first_of(" \t\r;")));
+  }
+  return skeletons;
+}
+
+// Models name their textures by the extension they had before they were
+// converted to .dds, relative to their own directory or its textures
+// subdirectory, or to the mod for those under data/. These are the paths,
+// in the order they are looked for.
+vector<string> embedded_texture_paths(string_view model_path,
+                                      string_view name) {
+  string n = asset_index::normalize(name);
+  vector<string> bases;
+  if (n.starts_with("data/"))
+    bases.push_back(n);
+  else {
+    string_view dir = model_path.substr(0, model_path.find_last_of("/\\"));
+    bases.push_back(fmt::format("{}/{}", dir, n));
+    bases.push_back(fmt::format("{}/textures/{}", dir, n));
+  }
+  vector<string> paths;
+  for (auto& base : bases) {
+    paths.push_back(fmt::format("{}.dds", base));
+    paths.push_back(move(base));
+  }
+  return paths;
+}
+
+bool embedded_texture_exists(string_view model_path, string_view name) {
+  for (const auto& path : embedded_texture_paths(model_path, name))
+    if (probe(path))
+      return true;
+  return false;
+}
+
+vector<problem> check_model(const asset_reference& ref,
+                            const unordered_set<string>& skeletons) {
+  vector<problem> problems;
+  string path = locate(ref.path);
+  mapped_file f;
+  if (f.open(path) == -1) {
+    problems.push_back({.kind = "unreadable-file",
+                        .message = fmt::format("{} could not be read: {}.",
+                                               sgr::file(path), errmsg()),
+                        .path = path});
+    return problems;
+  }
+  prof.count_parsed(f.view().size(), 1);
+  cas_model model;
+  if (string what = scan_cas(f.view(), model); not what.empty()) {
+    problems.push_back({.kind = "invalid-cas",
+                        .message = fmt::format("{} is not a valid model: {}.",
+                                               sgr::file(path),
+                                               sgr::problem(what)),
+                        .path = path});
+    return problems;
+  }
+  if (not skeletons.empty() and not model.skeleton.empty() and
+      not skeletons.contains(model.skeleton))
+    problems.push_back(
+      {.kind = "unknown-skeleton",
+       .message = fmt::format("Skeleton {} of {} is not declared in {}.",
+                              sgr::problem(model.skeleton), sgr::file(path),
+                              sgr::file(g::ds_filename)),
+       .path = path,
+       .file = string(g::ds_filename)});
+  for (const auto& texture : model.textures) {
+    if (not embedded_texture_exists(ref.path, texture))
+      problems.push_back(
+        {.kind = "missing-embedded-texture",
+         .message = fmt::format("Texture {} named by {} missing from path.",
+                                sgr::problem(texture), sgr::file(path)),
+         .path = path});
+  }
+  return problems;
+}
+
+size_t scan_models(const mod_state& st) {
+  profiler::span span("scan_models");
+  vector<asset_reference> refs = referenced_models(st);
+  unordered_set<string> skeletons = read_skeletons();
+  if (not g::quiet)
+    dcc_logmsg("Scanning {} models...", sgr::semiunique(refs.size()));
+  vector<vector<problem>> problems(refs.size());
+  auto scan = [&](size_t i) {
+    profiler::span entry("models", true);
+    problems[i] = check_model(refs[i], skeletons);
+  };
+  if (g::pool)
+    g::pool->parallel_for(refs.size(), scan);
+  else
+    for (size_t i = 0; i < refs.size(); ++i)
+      scan(i);
+
+  profiler::span reporting("report_models");
+  size_t flawed = 0;
+  for (size_t i = 0; i < refs.size(); ++i) {
+    flawed += not problems[i].empty();
+    add_problems(refs[i].path, refs[i].fname, refs[i].lineno,
+                 move(problems[i]));
+  }
+  if (flawed == 0 and not g::quiet)
+    dcc_logmsg("All {} models are valid.", sgr::semiunique(refs.size()));
+  return flawed;
+}
+
+string answer_query(const dependency_graph& graph, string_view name) {
+  using node_id = dependency_graph::node_id;
+  vector<node_id> found = graph.find(name);
+  if (found.empty())
+    return fmt::format("Nothing called {} is defined or referenced.\n",
+                       sgr::problem(name));
+
+  auto describe = [&graph](node_id id) {
+    const auto& n = graph.at(id);
+    string s = fmt::format("{} {}", kind_name(n.kind),
+                           n.kind == node_kind::file ? sgr::file(n.name)
+                                                     : sgr::unique(n.name));
+    if (not n.fname.empty())
+      s += fmt::format(" at {}", sgr::file(fmt::format("{}:{}", n.fname,
+                                                       n.lineno)));
+    else if (n.kind != node_kind::file)
+      s += ", defined nowhere";
+    return s;
+  };
+  string out;
+  unordered_set<node_id> seen;
+  size_t units = 0, characters = 0, banners = 0;
+
+  // Users are listed in the order of their definitions, and each only once;
+  // later mentions point back at the first.
+  auto list = [&](auto& self, node_id id, size_t depth) -> void {
+    vector<node_id> users(graph.users(id).begin(), graph.users(id).end());
+    sort(users.begin(), users.end(), [&graph](node_id a, node_id b) {
+      const auto& x = graph.at(a);
+      const auto& y = graph.at(b);
+      return tie(x.fname, x.lineno, x.name) < tie(y.fname, y.lineno, y.name);
+    });
+    for (node_id user : users) {
+      bool first = seen.insert(user).second;
+      out += fmt::format("{:{}}{}{}\n", "", depth * 2, describe(user),
+                         first ? "" : " (see above)");
+      if (not first)
+        continue;
+      node_kind kind = graph.at(user).kind;
+      units += kind == node_kind::unit;
+      characters += kind == node_kind::character;
+      banners += kind == node_kind::banner;
+      self(self, user, depth + 1);
+    }
+  };
+  for (node_id id : found) {
+    seen.insert(id);
+    out += fmt::format("{}{}\n", describe(id),
+                       graph.users(id).empty() ? ", used by nothing" : ":");
+    list(list, id, 1);
+  }
+  out += fmt::format("{} units, {} characters and {} banners depend on {}.\n",
+                     sgr::semiunique(units), sgr::semiunique(characters),
+                     sgr::semiunique(banners), sgr::unique(name));
+  return out;
+}
+
+// The trees below data/ that the definition files take their models,
+// textures and unit cards from. The interface, terrain and the like are
+// loaded by the game itself, and would be all orphans.
+static constexpr string_view orphan_trees[] = {
+  "data/models_unit/", "data/models_strat/", "data/banners/",
+  "data/ui/units/", "data/ui/unit_info/"};
+
+string list_orphans(const dependency_graph& graph,
+                    const vector<asset_file>& files) {
+  auto for_each_file = [&files](auto fn) {
+    if (g::pool)
+      g::pool->parallel_for(files.size(), fn);
+    else
+      for (size_t i = 0; i < files.size(); ++i)
+        fn(i);
+  };
+  vector<string> normalized(files.size());
+  for_each_file([&](size_t i) {
+    normalized[i] = asset_index::normalize(files[i].path);
+  });
+
+  unordered_set<string> referenced;
+  for (dependency_graph::node_id id = 0; id < graph.size(); ++id)
+    if (graph.at(id).kind == node_kind::file)
+      referenced.insert(asset_index::normalize(graph.at(id).name));
+
+  // Textures can also be named by the models alone.
+  vector<vector<string>> embedded(files.size());
+  {
+    profiler::span span("embedded_textures");
+    for_each_file([&](size_t i) {
+      if (not normalized[i].ends_with(".cas") or
+          not referenced.contains(normalized[i]))
+        return;
+      mapped_file f;
+      cas_model model;
+      if (f.open(files[i].path) == -1 or
+          not scan_cas(f.view(), model).empty())
+        return;
+      for (const auto& texture : model.textures)
+        for (auto& path : embedded_texture_paths(normalized[i], texture))
+          embedded[i].push_back(move(path));
+    });
+  }
+  for (auto& paths : embedded)
+    for (auto& path : paths)
+      referenced.insert(move(path));
+
+  auto dir_of = [](string_view path) {
+    return path.substr(0, path.find_last_of('/'));
+  };
+  vector<char> looked_at(files.size()), orphaned(files.size());
+  for_each_file([&](size_t i) {
+    looked_at[i] = any_of(
+      begin(orphan_trees), end(orphan_trees),
+      [&](string_view tree) { return normalized[i].starts_with(tree); });
+    orphaned[i] = looked_at[i] and not referenced.contains(normalized[i]);
+  });
+
+  // Directories with the most to reclaim first.
+  struct orphan_dir {
+    string_view path;
+    vector<size_t> files;
+    uint64_t bytes = 0;
+  };
+  map<string_view, orphan_dir> dirs;
+  for (size_t i = 0; i < files.size(); ++i) {
+    if (not orphaned[i])
+      continue;
+    string_view path = files[i].path;
+    orphan_dir& d = dirs[dir_of(normalized[i])];
+    d.path = dir_of(path);
+    d.files.push_back(i);
+    d.bytes += files[i].size;
+  }
+  vector<const orphan_dir*> sorted;
+  for (const auto& [n, d] : dirs)
+    sorted.push_back(&d);
+  stable_sort(sorted.begin(), sorted.end(),
+              [](const auto* a, const auto* b) { return a->bytes > b->bytes; });
+
+  string out;
+  size_t count = 0;
+  uint64_t total = 0;
+  for (const auto* d : sorted) {
+    out += fmt::format("{}: {} files, {} bytes\n", sgr::file(d->path),
+                       sgr::semiunique(d->files.size()), d->bytes);
+    for (size_t i : d->files)
+      out += fmt::format("  {} ({} bytes)\n", sgr::file(files[i].path),
+                         files[i].size);
+    count += d->files.size();
+    total += d->bytes;
+  }
+  string trees;
+  for (string_view tree : orphan_trees)
+    trees += fmt::format("{}{}", trees.empty() ? "" : ", ",
+                         sgr::file(tree.substr(0, tree.size() - 1)));
+  out += fmt::format("{} of the {} files below {} are referenced by nothing, "
+                     "in {} directories, {} bytes ({:.1f} MiB) in all.\n",
+                     sgr::semiunique(count),
+                     sgr::semiunique(ranges::count(looked_at, 1)), trees,
+                     sgr::semiunique(dirs.size()), total, total / 1048576.0);
+  return out;
+}
+
+string list_unused_units(const vector<unit>& units,
+                         const vector<asset_file>& files) {
+  name_matcher matcher;
+  vector<uint32_t> names(units.size());
+  for (size_t i = 0; i < units.size(); ++i)
+    names[i] = matcher.add(units[i].type);
+  {
+    profiler::span span("build_matcher");
+    matcher.build();
+  }
+
+  // All names are looked for at once, one file per task. What is commented
+  // out doesn't count.
+  vector<vector<uint32_t>> found(files.size());
+  atomic<uint64_t> scanned = 0;
+  auto scan = [&](size_t i) {
+    profiler::span span("scan_file", true);
+    mapped_file f;
+    if (f.open(files[i].path) == -1) {
+      dcc_logerr("Could not map {}: {}.", sgr::file(files[i].path), errmsg());
+      return;
+    }
+    string_view text = f.view();
+    string utf8;
+    text_encoding encoding = detect_bom(text).encoding;
+    if (encoding == text_encoding::utf16le or
+        encoding == text_encoding::utf16be) {
+      if (read_text(files[i].path, utf8) == -1)
+        return;
+      text = utf8;
+    }
+    scanned += text.size();
+    for (const auto& m : matcher.find(text)) {
+      size_t line = text.rfind('\n', m.offset);
+      line = line == string_view::npos ? 0 : line + 1;
+      if (text.substr(line, m.offset - line).find(';') == string_view::npos)
+        found[i].push_back(m.name);
+    }
+    sort(found[i].begin(), found[i].end());
+    found[i].erase(unique(found[i].begin(), found[i].end()), found[i].end());
+  };
+  if (g::pool)
+    g::pool->parallel_for(files.size(), scan);
+  else
+    for (size_t i = 0; i < files.size(); ++i)
+      scan(i);
+
+  vector<vector<size_t>> referencing(matcher.size());
+  for (size_t i = 0; i < files.size(); ++i)
+    for (uint32_t name : found[i])
+      referencing[name].push_back(i);
+  string out, unused;
+  size_t nunused = 0;
+  for (size_t i = 0; i < units.size(); ++i) {
+    const auto& by = referencing[names[i]];
+    string where = fmt::format("{}:{}", g::edu_filename, units[i].lineno);
+    if (by.empty()) {
+      unused += fmt::format("  {} ({})\n", sgr::unique(units[i].type),
+                            sgr::file(where));
+      ++nunused;
+      continue;
+    }
+    out += fmt::format("{} ({}) is referenced by:\n",
+                       sgr::unique(units[i].type), sgr::file(where));
+    for (size_t f : by)
+      out += fmt::format("  {}\n", sgr::file(files[f].path));
+  }
+  if (nunused != 0)
+    out += fmt::format("Referenced by nothing:\n{}", unused);
+  out += fmt::format("{} of {} units are referenced by none of {} text files "
+                     "({:.1f} MiB).\n",
+                     sgr::semiunique(nunused), sgr::semiunique(units.size()),
+                     sgr::semiunique(files.size()), scanned / 1048576.0);
+  return out;
+}
+
+void write_report() {
+  profiler::span span("write_report");
+  if (not sources.empty()) {
+    vector<string> layers = {fs::current_path().generic_string()};
+    for (size_t i = 1; i < g::assets.layer_count(); ++i)
+      layers.push_back(g::assets.layer_root(i));
+    g::problems.name_layers(move(layers));
+    for (const auto& [path, layer] : sources)
+      g::problems.add_source(path, layer);
+    sources.clear();
+  }
+  if (g::problems.write(g::problems_format, g::problems_path) == -1)
+    dcc_logerr("Could not write the report to {}: {}.",
+               sgr::file(g::problems_path), errmsg());
+}
+
+vector<string_view> definition_files() {
+  vector<string_view> units = {g::edu_filename,     g::dmb_filename,
+                               g::eu_filename,      g::en_strs_filename,
+                               g::dsf_filename,     g::edb_filename};
+  vector<string_view> characters = {g::dc_filename, g::dms_filename};
+  vector<string_view> banners = {g::db_filename};
+  if (g::verify_all) {
+    units.insert(units.end(), characters.begin(), characters.end());
+    units.insert(units.end(), banners.begin(), banners.end());
+    return units;
+  }
+  if (g::verify_characters)
+    return characters;
+  if (g::verify_banners)
+    return banners;
+  return units;
+}
+
+vector<string_view> apply_changes(const vector<file_watcher::event>& events) {
+  unordered_set<string_view> changed;
+  for (const auto& e : events) {
+    if (e.path.empty()) {
+      dcc_loginf("Lost track of changes, starting over.");
+      g::assets.build("data");
+      for (string_view fname : definition_files())
+        changed.insert(fname);
+      continue;
+    }
+    if (e.removed)
+      g::assets.remove(e.path, e.directory);
+    else
+      g::assets.add(e.path);
+    string n = asset_index::normalize(e.path);
+    for (string_view fname : definition_files())
+      if (n == asset_index::normalize(fname) and not e.removed)
+        changed.insert(fname);
+  }
+  vector<string_view> reload;
+  for (string_view fname : definition_files())
+    if (changed.contains(fname))
+      reload.push_back(fname);
+  return reload;
+}
+
+string snapshot_path(string_view fname) {
+  return fmt::format("{}/{}.snapshot", g::cache_dir,
+                     fs::path(fname).filename().string());
+}
+
+// Parses `fname` into `out` with `parse`. With --snapshot, what was parsed is
+// read back from the file's snapshot instead if there is one for its current
+// content, and saved to it otherwise.
+template <class T>
+void parse_or_load(string_view fname, T& out, parse_arena* arena,
+                   T (*parse)(string_view, parse_arena*)) {
+  string path = locate(fname);
+  snapshot_source source;
+  if (not g::use_snapshots or hash_source(path, source) == -1) {
+    out = parse(path, arena);
+    return;
+  }
+  string snapshot = snapshot_path(fname);
+  if (load_snapshot(snapshot, source, arena, out) == 0)
+    return;
+  out = parse(path, arena);
+  error_code ec;
+  fs::create_directories(g::cache_dir, ec);
+  if (save_snapshot(snapshot, source, out) == -1)
+    dcc_logerr("Could not save {}: {}.", sgr::file(snapshot), errmsg());
+}
+
+// Parses `fname` into `st`, and returns the arena what was parsed is in. The
+// arena replaces that of the last parse only once the task is waited for, as
+// the other tasks share st.arenas.
+unique_ptr<parse_arena> load_file(mod_state& st, string_view fname) {
+  auto arena = make_unique<parse_arena>();
+  if (fname == g::edu_filename)
+    parse_or_load(fname, st.units, arena.get(), parse_units);
+  else if (fname == g::dmb_filename)
+    parse_or_load(fname, st.battle_models, arena.get(), parse_battle_models);
+  else if (fname == g::eu_filename)
+    st.export_units = read_export_units();
+  else if (fname == g::en_strs_filename)
+    st.en_strings = read_en_strings();
+  else if (fname == g::dc_filename)
+    parse_or_load(fname, st.strat_model_entries, arena.get(),
+                  parse_strat_model_entries);
+  else if (fname == g::dms_filename)
+    parse_or_load(fname, st.strat_models, arena.get(), parse_strat_models);
+  else if (fname == g::db_filename)
+    parse_or_load(fname, st.banners, arena.get(), parse_banners);
+  else if (fname == g::dsf_filename)
+    st.factions = parse_factions(locate(fname), arena.get());
+  else if (fname == g::edb_filename)
+    st.recruitments = parse_recruitments(locate(fname), arena.get());
+  return arena;
+}
+
+// Definition files only some checks need, that a mod may lack.
+bool optional(string_view fname) {
+  return fname == g::dsf_filename or fname == g::edb_filename;
+}
+
+parse_stage::parse_stage(mod_state& st, const vector<string_view>& fnames)
+    : st(&st) {
+  for (string_view fname : fnames) {
+    if (optional(fname) and not fs::exists(locate(fname))) {
+      dcc_loginf("No {}, so not checking what it defines.", sgr::file(fname));
+      continue;
+    }
+    bool is_text = fname == g::eu_filename or fname == g::en_strs_filename;
+    dcc_logmsg("{} {}...", is_text ? "Loading" : "Parsing", sgr::file(fname));
+    tasks.emplace_back(fname, async(launch::async, [&st, fname]() {
+                         return load_file(st, fname);
+                       }));
+  }
+}
+
+void parse_stage::wait(initializer_list<string_view> fnames) {
+  for (auto& [fname, task] : tasks)
+    if (find(fnames.begin(), fnames.end(), fname) != fnames.end())
+      join(fname, task);
+}
+
+void parse_stage::wait_all() {
+  for (auto& [fname, task] : tasks)
+    join(fname, task);
+}
+
+// Only now that what was parsed the last time is gone can its arena go.
+void parse_stage::join(string_view fname,
+                       future<unique_ptr<parse_arena>>& task) {
+  if (task.valid())
+    st->arenas[fname] = task.get();
+}
+
+void load(mod_state& st, const vector<string_view>& fnames) {
+  parse_stage(st, fnames).wait_all();
+}
+
+unit_rosters rosters_of(const mod_state& st) {
+  unit_rosters rosters;
+  for (const auto& f : st.factions)
+    rosters.factions.insert(f.name);
+  for (const auto& r : st.recruitments)
+    rosters.recruited.insert(r.unit_type);
+  return rosters;
+}
+
+void verify(const mod_state& st, parse_stage& stage) {
+  g::problem_count = 0;
+  auto units = [&]() {
+    stage.wait({g::edu_filename, g::dmb_filename, g::eu_filename,
+                g::en_strs_filename, g::dsf_filename, g::edb_filename});
+    return verify_units(st.units, st.battle_models, st.export_units,
+                        st.en_strings, rosters_of(st));
+  };
+  auto characters = [&]() {
+    stage.wait({g::dc_filename, g::dms_filename});
+    return verify_strat_models(st.strat_model_entries, st.strat_models);
+  };
+  auto banners = [&]() {
+    stage.wait({g::db_filename});
+    return verify_banners(st.banners);
+  };
+  auto assets = [&]() {
+    if (g::validate_assets or g::scan_models)
+      stage.wait_all();
+    if (g::validate_assets)
+      validate_assets(st);
+    if (g::scan_models)
+      scan_models(st);
+  };
+  if (not g::verify_all) {
+    if (g::verify_characters)
+      characters();
+    else if (g::verify_banners)
+      banners();
+    else
+      units();
+    assets();
+    write_report();
+    return;
+  }
+  size_t flawed_units = units();
+  size_t flawed_characters = characters();
+  size_t flawed_banners = banners();
+  assets();
+  write_report();
+  dcc_logmsg("Summary:");
+  auto summarize = [](string_view what, size_t flawed, size_t total) {
+    dcc_logmsg("  {:<11} {} of {} with problems.", fmt::format("{}:", what),
+               flawed == 0 ? sgr::semiunique(flawed) : sgr::problem(flawed),
+               sgr::semiunique(total));
+  };
+  summarize("Units", flawed_units, st.units.size());
+  summarize("Characters", flawed_characters, st.strat_model_entries.size());
+  summarize("Banners", flawed_banners, st.banners.size());
+}
+
+void verify(const mod_state& st) {
+  parse_stage parsed;
+  verify(st, parsed);
+}
+
+template size_t
+verify_units(const vector<unit>& units,
+             const unordered_map<string, battle_model>& battle_models,
+             const tag_index& export_units, const tag_index& en_strings,
+             const unit_rosters& rosters);
+template size_t verify_units(
+  const vector<unit_view>& units,
+  const unordered_map<string_view, battle_model_view>& battle_models,
+  const tag_index& export_units, const tag_index& en_strings,
+  const unit_rosters& rosters);
@@ -0,0 +1,276 @@
+#ifndef RRT_VERIFICATION_HPP
+#define RRT_VERIFICATION_HPP
+
+#include <functional>
+#include <future>
+#include <initializer_list>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <string_view>
+#include <unordered_map>
+#include <unordered_set>
+#include <vector>
+
+#include "asset_index.hpp"
+#include "common.hpp"
+#include "dependency_graph.hpp"
+#include "file_watcher.hpp"
+#include "report.hpp"
+#include "tag_index.hpp"
+#include "thread_pool.hpp"
+#include "verification_cache.hpp"
+
+namespace g {
+
+  // Starts comments in export_units.txt: U+00AC, in UTF-8.
+  inline const std::string_view commsym = "\xc2\xac";
+  inline const std::string_view edu_filename = "data/export_descr_unit.txt";
+  inline const std::string_view eu_filename = "data/text/export_units.txt";
+  inline const std::string_view en_strs_filename =
+    "data/string_overrides/en.strings";
+  inline const std::string_view dmb_filename = "data/descr_model_battle.txt";
+  inline const std::string_view dc_filename = "data/descr_character.txt";
+  inline const std::string_view db_filename = "data/descr_banners.txt";
+  inline const std::string_view dms_filename = "data/descr_model_strat.txt";
+  inline const std::string_view ds_filename = "data/descr_skeleton.txt";
+  inline const std::string_view dsf_filename = "data/descr_sm_factions.txt";
+  inline const std::string_view edb_filename =
+    "data/export_descr_buildings.txt";
+  inline const std::string_view cache_dir = ".rrtw-cache";
+  inline bool check_all_factions = false;
+  inline bool check_all_referenced_paths = false;
+  inline bool ignore_slave = false;
+  inline bool generate_export_units = false;
+  inline bool verify_characters = false;
+  inline bool verify_banners = false;
+  inline bool verify_all = false;
+  inline bool mapped = false;
+  inline bool compare_parsers = false;
+  inline bool use_cache = false;
+  inline bool use_snapshots = false;
+  inline bool watch = false;
+  inline bool stats = false;
+  inline bool validate_assets = false;
+  inline bool scan_models = false;
+  inline bool find_orphans = false;
+  inline bool find_unused_units = false;
+  inline bool serve = false;
+
+  // Directories given to --base, that the mod is layered over.
+  inline std::vector<std::string> base_dirs;
+
+  // Names and paths given to --query.
+  inline std::vector<std::string> queries;
+
+  // Where --serve listens for requests, empty for the default one.
+  inline std::string socket_path = "";
+
+  // Where --trace writes its trace events, empty if it wasn't given.
+  inline std::string trace_path = "";
+
+  // How and where problems are reported. An empty path means stderr.
+  inline report_format problems_format = report_format::human;
+  inline std::string problems_path = "";
+
+  // Problems are still counted, but neither they nor progress are printed.
+  inline bool quiet = false;
+  inline int problem_count = 0;
+  inline report problems;
+  inline std::string root_dir = "";
+  inline asset_index assets;
+  inline size_t jobs = 1;
+  inline std::unique_ptr<thread_pool> pool;
+  inline std::unordered_map<std::string, std::unique_ptr<verification_cache>>
+    caches;
+
+}; // namespace g
+
+// Checks whether `path` is in g::assets, and records the probe for the cache.
+bool probe(std::string_view path);
+
+tag_index read_export_units();
+tag_index read_en_strings();
+
+// The verify_* functions add the problems of every entry to g::problems, and
+// return how many entries had any.
+
+size_t verify_banners(const std::vector<banner>& banners);
+
+size_t verify_strat_models(
+  const std::vector<strat_model_entry>& strat_model_entries,
+  const std::unordered_map<std::string, strat_model>& strat_models);
+
+// The factions of descr_sm_factions.txt that units may be owned by, and the
+// unit types export_descr_buildings.txt recruits. Either is empty if the mod
+// doesn't have the file, and then isn't checked against.
+struct unit_rosters {
+  std::unordered_set<std::string_view> factions;
+  std::unordered_set<std::string_view> recruited;
+};
+
+// Instantiated for both the owning and the mapped records.
+template <class U, class Key, class BM>
+size_t verify_units(const std::vector<U>& units,
+                    const std::unordered_map<Key, BM>& battle_models,
+                    const tag_index& export_units,
+                    const tag_index& en_strings,
+                    const unit_rosters& rosters = {});
+
+// Everything parsed from the definition files, shared by all verifications
+// of a run and kept between passes by --watch.
+struct mod_state {
+  // The arena of each definition file, first so as to outlive what was
+  // parsed into it.
+  std::map<std::string_view, std::unique_ptr<parse_arena>> arenas;
+
+  std::vector<unit> units;
+  std::unordered_map<std::string, battle_model> battle_models;
+  tag_index export_units;
+  tag_index en_strings;
+  std::vector<strat_model_entry> strat_model_entries;
+  std::unordered_map<std::string, strat_model> strat_models;
+  std::vector<banner> banners;
+  std::vector<faction> factions;
+  std::vector<recruitment> recruitments;
+};
+
+// Points into `st`, which has to outlive it.
+unit_rosters rosters_of(const mod_state& st);
+
+// What checking the models units and characters share finds, worked out
+// once per model for all of them, by whichever thread gets there first. The
+// probes made doing so are recorded for every entry that shares them, as the
+// verification cache needs. Keyed by where the models are, so it has to be
+// cleared when they are parsed again.
+class check_memo {
+public:
+  // What is wrong with a battle model whichever unit uses it: missing models
+  // and default textures, then textures missing from disk.
+  struct battle_model_findings {
+    std::vector<problem> model;
+    std::vector<problem> textures;
+  };
+
+  const battle_model_findings&
+  battle_model(const void* bm,
+               const std::function<battle_model_findings()>& check);
+
+  // What is wrong with a strat model for `owner`.
+  const std::vector<problem>&
+  strat_model(const void* sm, std::string_view owner,
+              const std::function<std::vector<problem>()>& check);
+
+  void clear();
+
+private:
+  template <class T>
+  struct slot {
+    std::once_flag once;
+    T findings;
+    std::vector<verification_cache::probe> probes;
+  };
+
+  template <class T>
+  static const T& find_or_check(slot<T>& s, const std::function<T()>& check);
+
+  std::mutex m;
+  std::unordered_map<const void*, std::unique_ptr<slot<battle_model_findings>>>
+    battle_models;
+  std::unordered_map<
+    const void*,
+    std::unordered_map<std::string, std::unique_ptr<slot<std::vector<problem>>>,
+                       string_hash, std::equal_to<>>>
+    strat_models;
+};
+
+// The problems of every unit, character and banner, one list per entry in
+// the order of `st`, as the verify_* functions find them. With --cache,
+// --watch or --serve, entries that didn't change since the last pass are not
+// checked again.
+std::vector<std::vector<problem>> check_units(const mod_state& st,
+                                              const unit_rosters& rosters);
+std::vector<std::vector<problem>> check_characters(const mod_state& st);
+std::vector<std::vector<problem>> check_banners(const mod_state& st);
+
+// Reads the headers of every DDS texture and TGA unit card the loaded
+// definition files reference and adds the problems of the broken ones to
+// g::problems, returning how many there were.
+size_t validate_assets(const mod_state& st);
+
+// Scans every .cas model the loaded definition files reference, once each,
+// for the skeleton and textures it names, and adds the problems of the
+// broken ones to g::problems, returning how many there were.
+size_t scan_models(const mod_state& st);
+
+// Lists everything that depends on the entries or file called `name`,
+// directly or not, as a tree, and sums up the units, characters and banners
+// that come to.
+std::string answer_query(const dependency_graph& graph, std::string_view name);
+
+// Lists the `files` that nothing in `graph` nor the models it reaches
+// references, grouped by directory, biggest first. Only the trees the
+// definition files take their models, textures and unit cards from are
+// considered.
+std::string list_orphans(const dependency_graph& graph,
+                         const std::vector<asset_file>& files);
+
+// Lists the `units` that none of the text `files` mention by type, and for
+// the others, the files that do. Mentions after a `;` on their line are
+// comments, and don't count.
+std::string list_unused_units(const std::vector<unit>& units,
+                              const std::vector<asset_file>& files);
+
+// Where to read `path` from: the file of the first layer that has it, or
+// `path` itself if none does, so that opening it fails the way it should.
+std::string locate(std::string_view path);
+
+// Writes out the problems collected by the verify_* functions so far.
+void write_report();
+
+// Definition files the selected verification reads.
+std::vector<std::string_view> definition_files();
+
+// Whether any result checked with --cache, --watch or --serve so far depended
+// on whether `path` exists, or for a `directory`, on anything below it.
+bool probed(std::string_view path, bool directory);
+
+// Brings g::assets up to date with `events`, and returns the definition files
+// they changed, in the order of definition_files().
+std::vector<std::string_view>
+apply_changes(const std::vector<file_watcher::event>& events);
+
+// Definition files being parsed into a mod_state, each by a task of its
+// own, so that each verifier only waits for the files it reads. Files the mod
+// doesn't have and can do without are left out.
+class parse_stage {
+public:
+  parse_stage() = default;
+  parse_stage(mod_state& st, const std::vector<std::string_view>& fnames);
+  parse_stage(const parse_stage&) = delete;
+  parse_stage& operator=(const parse_stage&) = delete;
+  ~parse_stage() { wait_all(); }
+
+  // Waits until those of `fnames` that are being parsed are.
+  void wait(std::initializer_list<std::string_view> fnames);
+  void wait_all();
+
+private:
+  void join(std::string_view fname,
+            std::future<std::unique_ptr<parse_arena>>& task);
+
+  mod_state* st = nullptr;
+  std::vector<
+    std::pair<std::string_view, std::future<std::unique_ptr<parse_arena>>>>
+    tasks;
+};
+
+// Parses the given definition files, all at the same time.
+void load(mod_state& st, const std::vector<std::string_view>& fnames);
+
+// Runs the selected verification, on files `stage` may still be parsing.
+void verify(const mod_state& st, parse_stage& stage);
+void verify(const mod_state& st);
+
+#endif
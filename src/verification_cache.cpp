@@ -0,0 +1,111 @@
+#include "verification_cache.hpp"
+
+#include <charconv>
+#include <fstream>
+#include <sstream>
+
+using namespace std;
+
+// Bumped whenever the layout below or the meaning of a hash changes.
+static const string_view cache_header = "rrtw-cache 2";
+
+void content_hasher::add(const void* data, size_t size) {
+  const unsigned char* p = static_cast<const unsigned char*>(data);
+  for (size_t i = 0; i < size; ++i) {
+    h ^= p[i];
+    h *= 1099511628211ull;
+  }
+}
+
+content_hasher& content_hasher::operator<<(string_view s) {
+
+  // The length keeps e.g. ("ab", "c") and ("a", "bc") apart.
+  *this << uint64_t(s.size());
+  add(s.data(), s.size());
+  return *this;
+}
+
+content_hasher& content_hasher::operator<<(uint64_t n) {
+  add(&n, sizeof(n));
+  return *this;
+}
+
+int verification_cache::load(string_view path) {
+  ifstream f(string(path), ios::binary);
+  string line;
+  if (not f or not getline(f, line) or line != cache_header)
+    return -1;
+  while (getline(f, line)) {
+    istringstream head(line);
+    uint64_t hash;
+    size_t nprobes, nproblems;
+    if (not(head >> hex >> hash >> dec >> nprobes >> nproblems)) {
+      loaded.clear();
+      return -1;
+    }
+    result r;
+    for (size_t i = 0; i < nprobes and getline(f, line); ++i) {
+      if (line.size() < 2 or (line[0] != '0' and line[0] != '1') or
+          line[1] != ' ')
+        break;
+      r.probes.push_back({line.substr(2), line[0] == '1'});
+    }
+    for (size_t i = 0; i < nproblems and getline(f, line); ++i) {
+      problem p;
+      istringstream fields(line);
+      string lineno;
+      if (not getline(fields, p.kind, '\t') or
+          not getline(fields, p.path, '\t') or
+          not getline(fields, p.faction, '\t') or
+          not getline(fields, p.file, '\t') or
+          not getline(fields, lineno, '\t') or
+          not getline(fields, p.message))
+        break;
+      const char* end = lineno.data() + lineno.size();
+      auto [ptr, ec] = from_chars(lineno.data(), end, p.lineno);
+      if (ec != errc() or ptr != end)
+        break;
+      r.problems.push_back(move(p));
+    }
+    if (r.probes.size() != nprobes or r.problems.size() != nproblems) {
+      loaded.clear();
+      return -1;
+    }
+    loaded.emplace(hash, move(r));
+  }
+  return 0;
+}
+
+int verification_cache::save(string_view path) const {
+  ofstream f(string(path), ios::binary);
+  if (not f)
+    return -1;
+  f << cache_header << '\n';
+  for (const auto& [hash, r] : stored) {
+    f << hex << hash << dec << ' ' << r.probes.size() << ' '
+      << r.problems.size() << '\n';
+    for (const auto& p : r.probes)
+      f << (p.exists ? '1' : '0') << ' ' << p.path << '\n';
+    for (const auto& p : r.problems)
+      f << p.kind << '\t' << p.path << '\t' << p.faction << '\t' << p.file
+        << '\t' << p.lineno << '\t' << p.message << '\n';
+  }
+  return f ? 0 : -1;
+}
+
+const verification_cache::result*
+verification_cache::find(uint64_t hash) const {
+  auto it = loaded.find(hash);
+  return it == loaded.end() ? nullptr : &it->second;
+}
+
+void verification_cache::store(uint64_t hash, result r) {
+  lock_guard l(m);
+  stored.emplace(hash, move(r));
+}
+
+void verification_cache::advance() {
+  lock_guard l(m);
+  loaded = move(stored);
+  stored.clear();
+}
@@ -0,0 +1,64 @@
+#ifndef RRT_VERIFICATION_CACHE_HPP
+#define RRT_VERIFICATION_CACHE_HPP
+
+#include <cstdint>
+#include <mutex>
+#include <string>
+#include <string_view>
+#include <unordered_map>
+#include <vector>
+
+#include "report.hpp"
+
+// FNV-1a over everything an entry's verification depends on.
+class content_hasher {
+public:
+  content_hasher& operator<<(std::string_view s);
+  content_hasher& operator<<(uint64_t n);
+  uint64_t value() const { return h; }
+
+private:
+  void add(const void* data, size_t size);
+  uint64_t h = 14695981039346656037ull;
+};
+
+// Problems found for entries on earlier runs, keyed by the hash of the entry's
+// content, along with the results of the file probes made while verifying it.
+// An entry whose hash is known and whose probes still give the same results
+// doesn't have to be verified again.
+class verification_cache {
+public:
+  struct probe {
+    std::string path;
+    bool exists;
+  };
+
+  struct result {
+    std::vector<probe> probes;
+    std::vector<problem> problems;
+  };
+
+  // Loads results saved by an earlier run. Returns -1 if there are none or
+  // they could not be read, in which case the cache starts out empty.
+  int load(std::string_view path);
+
+  // Saves the results stored during this run, dropping the stale ones.
+  int save(std::string_view path) const;
+
+  // Returns the result of an earlier run for `hash`, or null.
+  const result* find(uint64_t hash) const;
+
+  // Keeps `r` for the next run. Safe to call from several threads.
+  void store(uint64_t hash, result r);
+
+  // Makes the results stored so far the ones found by the next pass, for
+  // when the cache stays loaded between passes.
+  void advance();
+
+private:
+  std::unordered_map<uint64_t, result> loaded;
+  std::unordered_map<uint64_t, result> stored;
+  std::mutex m;
+};
+
+#endif
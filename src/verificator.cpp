@@ -1,13 +1,24 @@
 #include <dcc/errno.hpp>
 #include <dcc/file.hpp>
 #include <dcc/logger.hpp>
+#include <algorithm>
+#include <chrono>
 #include <filesystem>
 #include <fstream>
-#include <regex>
+#include <memory>
 #include <string_view>
 #include <unordered_set>
 
+#include "asset_index.hpp"
 #include "common.hpp"
+#include "daemon.hpp"
+#include "encoding.hpp"
+#include "file_watcher.hpp"
+#include "mapped_file.hpp"
+#include "profiler.hpp"
+#include "tag_index.hpp"
+#include "thread_pool.hpp"
+#include "verification.hpp"
 
 using namespace std;
 using namespace dcc;
@@ -17,219 +28,10 @@ namespace fs = std::filesystem;
 #define ROOT_MOD_DIR "../../RIS"
 #endif
 
-namespace g {
-
-  const char commsym = (char)172;
-  const string_view edu_filename = "data/export_descr_unit.txt";
-  const string_view eu_filename = "data/text/export_units.txt";
-  const string_view en_strs_filename = "data/string_overrides/en.strings";
-  const string_view dmb_filename = "data/descr_model_battle.txt";
-  const string_view dc_filename = "data/descr_character.txt";
-  const string_view db_filename = "data/descr_banners.txt";
-  const string_view dms_filename = "data/descr_model_strat.txt";
-  bool check_all_factions = false;
-  bool check_all_referenced_paths = false;
-  bool ignore_slave = false;
-  bool generate_export_units = false;
-  bool verify_characters = false;
-  bool verify_banners = false;
-  bool no_problems = true;
-  int problem_count = 0;
-  string root_dir = "";
-
-}; // namespace g
-
-void verify_banners() {
-  dcc_logmsg("Parsing {}...", sgr::file(g::db_filename));
-
-  vector<banner> banners = parse_banners(g::db_filename);
-  dcc_logmsg("Verifying banners...");
-  for (const auto& ban : banners) {
-    vector<string> problems;
-    for (const auto& texpath : ban.texture_paths) {
-      if (not fs::exists(texpath))
-        problems.push_back(
-          fmt::format("Texture {} missing from path.", sgr::file(texpath)));
-    }
-    if (not problems.empty()) {
-      g::no_problems = false;
-      ++g::problem_count;
-      flogmsg(stderr, "", "\n{} {} at {}:",
-              fmt::format(fg(fmt::color::white), "{})", g::problem_count),
-              sgr::unique(ban.type),
-              sgr::file(fmt::format("{}:{}", g::db_filename, ban.lineno)));
-      for (size_t i = 0; i < problems.size(); ++i)
-        flogmsg(stderr, "", "\t {} {}{}",
-                fmt::format(fmt::fg(fmt::color::white), "{}.", i + 1),
-                string(int(log10(problems.size())) - int(log10(i + 1)), ' '),
-                problems[i]);
-    }
-  }
-  if (g::no_problems)
-    dcc_logmsg("All {} banners are valid.", sgr::semiunique(banners.size()));
-}
-
-void verify_strat_models() {
-  dcc_logmsg("Parsing {}...", sgr::file(g::dc_filename));
-
-  vector<strat_model_entry> strat_model_entries;
-  strat_model_entries = parse_strat_model_entries(g::dc_filename);
-  dcc_logmsg("Parsing {}...", sgr::file(g::dms_filename));
-
-  unordered_map<std::string, strat_model> strat_models;
-  strat_models = parse_strat_models(g::dms_filename);
-  dcc_logmsg("Verifying characters...");
-  for (const auto& entry : strat_model_entries) {
-    unordered_set<string> handled_models;
-    vector<string> problems;
-
-    // // strat_cards
-    // for (const auto& [owner, scstr] : entry.strat_cards) {
-    //   if (owner == "slave" and g::ignore_slave)
-    //     continue;
-    //   if (not fs::exists(scstr)) {
-    //     problems.push_back(
-    //       fmt::format("strat_card {} missing from path for {}.",
-    //                   sgr::file(scstr), sgr::unique(owner)));
-    //   }
-    // }
-    for (const auto& [owner, modelstr] : entry.models) {
-      if (owner == "slave" and g::ignore_slave)
-        continue;
-      if (not strat_models.contains(modelstr)) {
-        problems.push_back(fmt::format("No entry for {} found in {}.",
-                                       sgr::semiunique(modelstr),
-                                       sgr::file(g::dms_filename)));
-      }
-      else {
-        if (handled_models.contains(modelstr))
-          continue;
-        handled_models.insert(modelstr);
-
-        bool got_default_pbr_tex = true;
-        bool got_default_tex = true;
-        auto& sm = strat_models.at(modelstr);
-        auto ddspath = [](const string_view tpath) {
-          return fmt::format("{}.dds", tpath);
-        };
-
-        // PBR textures
-        if (not sm.pbr_textures.contains("default")) {
-          problems.push_back(fmt::format(
-            "Missing default pbr_texture for {} at {}.",
-            sgr::semiunique(modelstr),
-            sgr::file(fmt::format("{}:{}", g::dms_filename, sm.lineno))));
-          got_default_pbr_tex = false;
-        }
-        else if (not fs::exists(ddspath(sm.pbr_textures.at("default").path))) {
-          texture& t = sm.pbr_textures.at("default");
-          problems.push_back(fmt::format(
-            "Default texture {} for {} is missing from path at {}.",
-            sgr::file(ddspath(t.path)), sgr::semiunique(modelstr),
-            sgr::file(fmt::format("{}:{}", g::dms_filename, t.lineno))));
-          got_default_pbr_tex = false;
-        }
-        if (not sm.pbr_textures.contains(owner)) {
-          if (not got_default_pbr_tex or g::check_all_factions) {
-            problems.push_back(fmt::format(
-              "Missing {} pbr_texture at for {} at {}.", sgr::unique(owner),
-              sgr::semiunique(modelstr),
-              sgr::file(fmt::format("{}:{}", g::dms_filename, sm.lineno))));
-          }
-        }
-        else if (not got_default_pbr_tex or g::check_all_referenced_paths) {
-          texture& t = sm.textures.at(owner);
-          if (not fs::exists(ddspath(t.path))) {
-            problems.push_back(fmt::format(
-              "Texture {} for {} for {} missing from path at {}.",
-              sgr::file(ddspath(t.path)), sgr::semiunique(modelstr),
-              sgr::unique(owner),
-              sgr::file(fmt::format("{}:{}", g::dms_filename, t.lineno))));
-          }
-        }
-
-        // Regular textures
-        if (not sm.textures.contains("default")) {
-          problems.push_back(fmt::format(
-            "Missing default texture for {} at {}.", sgr::semiunique(modelstr),
-            sgr::file(fmt::format("{}:{}", g::dms_filename, sm.lineno))));
-          got_default_tex = false;
-        }
-        else if (not fs::exists(ddspath(sm.textures.at("default").path))) {
-          texture& t = sm.textures.at("default");
-          problems.push_back(fmt::format(
-            "Default texture {} for {} is missing from path at {}.",
-            sgr::file(ddspath(t.path)), sgr::semiunique(modelstr),
-            sgr::file(fmt::format("{}:{}", g::dms_filename, t.lineno))));
-          got_default_tex = false;
-        }
-        if (not sm.textures.contains(owner)) {
-          if (not got_default_tex or g::check_all_factions) {
-            problems.push_back(fmt::format(
-              "Missing {} texture at for {} at {}.", sgr::unique(owner),
-              sgr::semiunique(modelstr),
-              sgr::file(fmt::format("{}:{}", g::dms_filename, sm.lineno))));
-          }
-        }
-        else if (not got_default_tex or g::check_all_referenced_paths) {
-          texture& t = sm.textures.at(owner);
-          if (not fs::exists(ddspath(t.path))) {
-            problems.push_back(fmt::format(
-              "Texture {} for {} for {} missing from path at {}.",
-              sgr::file(ddspath(t.path)), sgr::semiunique(modelstr),
-              sgr::unique(owner),
-              sgr::file(fmt::format("{}:{}", g::dms_filename, t.lineno))));
-          }
-        }
-
-        // Models
-        if (sm.path.empty()) {
-          problems.push_back(fmt::format(
-            "Missing model_flexi for {} at {}.", sgr::semiunique(modelstr),
-            sgr::file(fmt::format("{}:{}", g::dms_filename, sm.lineno))));
-        }
-        else if (not fs::exists(sm.path)) {
-          problems.push_back(fmt::format(
-            "Model {} is missing from path at {}.", sgr::file(sm.path),
-            sgr::file(fmt::format("{}:{}", g::dms_filename, sm.lineno))));
-        }
-        if (sm.nv_path.empty()) {
-          problems.push_back(fmt::format(
-            "Missing no_variation model_flexi for {} at {}.",
-            sgr::unique(modelstr),
-            sgr::file(fmt::format("{}:{}", g::dms_filename, sm.lineno))));
-        }
-        else if (sm.nv_path != sm.path and not fs::exists(sm.nv_path)) {
-          problems.push_back(fmt::format(
-            "Model {} is missing from path at {}.", sgr::file(sm.nv_path),
-            sgr::file(fmt::format("{}:{}", g::dms_filename, sm.lineno))));
-        }
-      }
-    }
-
-    if (not problems.empty()) {
-      g::no_problems = false;
-      ++g::problem_count;
-      flogmsg(stderr, "", "\n{} {} at {}:",
-              fmt::format(fg(fmt::color::white), "{})", g::problem_count),
-              sgr::unique(entry.type),
-              sgr::file(fmt::format("{}:{}", g::dc_filename, entry.lineno)));
-      for (size_t i = 0; i < problems.size(); ++i)
-        flogmsg(stderr, "", "\t {} {}{}",
-                fmt::format(fmt::fg(fmt::color::white), "{}.", i + 1),
-                string(int(log10(problems.size())) - int(log10(i + 1)), ' '),
-                problems[i]);
-    }
-  }
-  if (g::no_problems)
-    dcc_logmsg("All {} character models are valid.",
-               sgr::semiunique(strat_models.size()));
-}
-
 void generate_export_units(string_view progname) {
   dcc_logmsg("Parsing {}...", sgr::file(g::edu_filename));
 
-  vector<unit> units = parse_units(g::edu_filename);
+  vector<unit> units = parse_units(locate(g::edu_filename));
   ofstream eu(g::eu_filename.data(), ios::binary);
   string eustr;
   if (not eu) {
@@ -261,219 +63,233 @@ void generate_export_units(string_view progname) {
                          unit.dictionary);
   }
 
-  // This file needs to be in UTF16LE.
-  // This is a very primitive solution, and I am in no way proud of it, but my
-  // quest in leveraging the standard library for mystic conversion between
-  // encodings ended poorly, so I just did it the only fashioned way.
-  char nullbyte = 0x0;
-  wchar_t bom = 0xfeff; // UTF16LE BOM
-  eu.write((char*)&bom, sizeof(wchar_t));
-  for (size_t i = 0, j = 0; i != eustr.length() - 1; ++j) {
-    if (j % 2 == 0) {
-      eu.write((char*)(eustr.data() + i), sizeof(char));
-      ++i;
-    }
-    else
-      eu.write((char*)&nullbyte, sizeof(char));
+  // This file needs to be in UTF-16LE.
+  string out = "\xff\xfe";
+  utf8_to_utf16le(eustr, out);
+  if (not eu.write(out.data(), out.size())) {
+    dcc_logerr("Could not write {}: {}.", sgr::file(g::eu_filename), errmsg());
+    exit(-1);
   }
   dcc_logmsg("Finished generating {}.", sgr::file(g::eu_filename));
 }
 
-void verify_units() {
-  dcc_logmsg("Parsing {}...", sgr::file(g::edu_filename));
-
-  vector<unit> units = parse_units(g::edu_filename);
-
-  dcc_logmsg("Parsing {}...", sgr::file(g::dmb_filename));
+mapped_file map_file(string_view fname) {
+  mapped_file f;
+  if (f.open(locate(fname)) == -1) {
+    dcc_logerr("Could not map {}: {}.", sgr::file(fname), errmsg());
+    exit(-1);
+  }
+  return f;
+}
 
-  unordered_map<string, battle_model> battle_models =
-    parse_battle_models(g::dmb_filename);
+// Verifies units from mapped definition files, see parse_units(mapped_file).
+void verify_mapped_units() {
 
+  // The parsed records point into these, so they have to outlive the
+  // verification.
+  dcc_logmsg("Mapping {}...", sgr::file(g::edu_filename));
+  mapped_file edu = map_file(g::edu_filename);
+  dcc_logmsg("Mapping {}...", sgr::file(g::dmb_filename));
+  mapped_file dmb = map_file(g::dmb_filename);
   dcc_logmsg("Loading {}...", sgr::file(g::eu_filename));
+  tag_index export_units = read_export_units();
+  dcc_logmsg("Loading {}...", sgr::file(g::en_strs_filename));
+  tag_index en_strings = read_en_strings();
+  mod_state st;
+  load(st, {g::dsf_filename, g::edb_filename});
+  verify_units(parse_units(edu), parse_battle_models(dmb), export_units,
+               en_strings, rosters_of(st));
+  write_report();
+}
 
-  string export_units;
-  if (freadall(g::eu_filename.data(), export_units) == -1) {
-    dcc_logerr("Could not read {}: {}", sgr::file(g::eu_filename), errmsg());
-    exit(-1);
-  }
-
-  string en_strings;
-  if (freadall(g::en_strs_filename.data(), en_strings) == -1) {
-    dcc_logerr("Could not read {}: {}.", sgr::file(g::en_strs_filename),
+// Prints --stats and writes --trace for everything recorded so far.
+void report_profile() {
+  if (g::stats)
+    prof.print_stats(stdout);
+  if (not g::trace_path.empty() and prof.write_trace(g::trace_path) == -1)
+    dcc_logerr("Could not write {}: {}.", sgr::file(g::trace_path),
                errmsg());
+}
+
+// Verifies, then keeps everything parsed and re-verifies whenever something
+// below data/ changes. Only changed definition files are parsed again, and
+// thanks to the cache only entries whose inputs changed are checked again.
+void watch() {
+  mod_state st;
+  load(st, definition_files());
+  verify(st);
+  report_profile();
+
+  file_watcher watcher;
+  if (watcher.watch_tree("data") == -1) {
+    dcc_logerr("Could not watch {}: {}.", sgr::file("data"), errmsg());
     exit(-1);
   }
+  for (;;) {
+    dcc_loginf("Watching {} for changes...", sgr::file("data"));
+    vector<file_watcher::event> events =
+      watcher.wait(chrono::milliseconds(50));
+    if (events.empty())
+      continue;
+    auto start = chrono::steady_clock::now();
+    prof.reset();
+    vector<string_view> reload = apply_changes(events);
+    load(st, reload);
+    verify(st);
+    report_profile();
+    chrono::duration<double, milli> took = chrono::steady_clock::now() - start;
+    dcc_loginf("Re-verified in {:.1f} ms.", took.count());
+  }
+}
 
-  dcc_logmsg("Verifying units...");
-  for (const unit& u : units) {
-    vector<string> problems;
-    vector<string> str_entries = {u.dictionary,
-                                  fmt::format("{}_descr", u.dictionary),
-                                  fmt::format("{}_descr_short", u.dictionary)};
-    smatch m;
+// Parses every definition file, and answers the --query lookups from their
+// dependency graph.
+void query() {
+  g::verify_all = true;
+  mod_state st;
+  load(st, definition_files());
+  auto start = chrono::steady_clock::now();
+  dependency_graph graph;
+  {
+    profiler::span span("dependency_graph");
+    graph.build(st);
+  }
+  chrono::duration<double, milli> took = chrono::steady_clock::now() - start;
+  dcc_loginf("Linked {} entries and files by {} dependencies in {:.1f} ms.",
+             sgr::semiunique(graph.size()), sgr::semiunique(graph.edge_count()),
+             took.count());
+  for (const auto& name : g::queries) {
+    profiler::span span("query");
+    string answer = answer_query(graph, name);
+    fwrite(answer.data(), 1, answer.size(), stdout);
+  }
+}
 
-    // Verify export_units.txt
-    for (const auto& s : str_entries) {
-      if (not regex_search(export_units, m,
-                           regex(fmt::format("(\\{{{}\\}})", s))))
-        problems.push_back(fmt::format("{} missing from {}.",
-                                       sgr::problem(fmt::format("{{{}}}", s)),
-                                       sgr::file(g::eu_filename)));
-    }
+// Parses every definition file, walks data/ for the textures, unit cards and
+// models in it, and lists those nothing references.
+void find_orphans() {
+  g::verify_all = true;
+  mod_state st;
+  load(st, definition_files());
+  dependency_graph graph;
+  {
+    profiler::span span("dependency_graph");
+    graph.build(st);
+  }
+  auto start = chrono::steady_clock::now();
+  vector<asset_file> files;
+  {
+    profiler::span span("list_files");
+    files = list_files("data", {".dds", ".tga", ".cas"},
+                       g::pool ? g::pool->size() : 1);
+  }
+  chrono::duration<double, milli> took = chrono::steady_clock::now() - start;
+  dcc_loginf("Found {} textures, unit cards and models in {:.1f} ms.",
+             sgr::semiunique(files.size()), took.count());
+  profiler::span span("list_orphans");
+  string orphans = list_orphans(graph, files);
+  fwrite(orphans.data(), 1, orphans.size(), stdout);
+}
 
-    // Verify en.strings
-    for (const auto& s : str_entries) {
-      if (not regex_search(en_strings, m,
-                           regex(fmt::format("\"Rome\\.Override\\.{}\"", s))))
-        problems.push_back(
-          fmt::format("{} missing from {}.",
-                      sgr::problem(fmt::format("Rome.Override.{}", s)),
-                      sgr::file(g::en_strs_filename)));
-    }
+// Parses export_descr_unit.txt, and lists the units that no text file below
+// data/ besides the unit definitions themselves mentions.
+void find_unused_units() {
+  mod_state st;
+  load(st, {g::edu_filename});
+  auto start = chrono::steady_clock::now();
+  vector<asset_file> files;
+  {
+    profiler::span span("list_files");
+    files = list_files("data", {".txt"}, g::pool ? g::pool->size() : 1);
+  }
+  erase_if(files, [](const asset_file& f) {
+    string n = asset_index::normalize(f.path);
+    return n == asset_index::normalize(g::edu_filename) or
+           n == asset_index::normalize(g::eu_filename);
+  });
+  chrono::duration<double, milli> took = chrono::steady_clock::now() - start;
+  dcc_loginf("Found {} text files in {:.1f} ms.", sgr::semiunique(files.size()),
+             took.count());
+  profiler::span span("list_unused_units");
+  string unused = list_unused_units(st.units, files);
+  fwrite(unused.data(), 1, unused.size(), stdout);
+}
 
-    // Verify unit cards
-    if (u.mercenary) {
+// Keeps the mod parsed and verified, answering requests for single entries
+// and files at a local socket until asked to stop.
+void serve_requests() {
+  string path = g::socket_path;
+  if (path.empty()) {
+    fs::create_directories(g::cache_dir);
+    path = fmt::format("{}/verificator.sock", g::cache_dir);
+  }
+  if (serve(path) == -1) {
+    dcc_logerr("Could not serve at {}: {}.", sgr::file(path), errmsg());
+    exit(-1);
+  }
+}
 
-      // This is a mercenary unit, so we should verify it has unit cards for
-      // the mercenary faction only.
-      string unit_card = fmt::format("#{}.tga", u.dictionary);
-      if (not fs::exists(fmt::format("data/ui/units/mercs/{}", unit_card)))
-        problems.push_back(fmt::format("{} missing from {}.",
-                                       sgr::problem(unit_card),
-                                       sgr::file("ui/units/mercs")));
-      unit_card = fmt::format("{}_info.tga", u.dictionary);
-      if (not fs::exists(fmt::format("data/ui/unit_info/merc/{}", unit_card)))
-        problems.push_back(fmt::format("{} missing from {}.",
-                                       sgr::problem(unit_card),
-                                       sgr::file("data/ui/unit_info/merc")));
+// Parses export_descr_unit.txt and descr_model_battle.txt with both the dcc
+// parsers and ours, and reports how long each took and where their results
+// differ.
+void compare_parsers() {
+  auto timed = [](auto parse) {
+    auto start = chrono::steady_clock::now();
+    auto result = parse();
+    chrono::duration<double, milli> took = chrono::steady_clock::now() - start;
+    return pair(move(result), took.count());
+  };
+  size_t mismatches = 0;
+
+  auto [units, units_ms] =
+    timed([]() { return parse_units_with_dcc(locate(g::edu_filename)); });
+  mapped_file edu;
+  auto [unit_views, unit_views_ms] = timed([&edu]() {
+    edu = map_file(g::edu_filename);
+    return parse_units(edu);
+  });
+  dcc_loginf("{}: {} units in {:.2f} ms parsed, {} in {:.2f} ms mapped.",
+             sgr::file(g::edu_filename), units.size(), units_ms,
+             unit_views.size(), unit_views_ms);
+  for (size_t i = 0; i < min(units.size(), unit_views.size()); ++i) {
+    if (units[i] != to_unit(unit_views[i])) {
+      dcc_logerr("{} at {} differs between parsers.",
+                 sgr::unique(units[i].dictionary),
+                 sgr::file(fmt::format("{}:{}", g::edu_filename,
+                                       units[i].lineno)));
+      ++mismatches;
     }
-    else {
-      if (u.owners.empty())
-        problems.push_back("This unit has no owners.");
-      for (const auto& owner : u.owners) {
-        if (g::ignore_slave and owner == "slave")
-          continue;
-
-        string unit_card = fmt::format("#{}.tga", u.dictionary);
-        if (not fs::exists(
-              fmt::format("data/ui/units/{}/{}", owner, unit_card)))
-          problems.push_back(
-            fmt::format("{} missing from {}.", sgr::problem(unit_card),
-                        sgr::file(fmt::format("data/ui/units/{}", owner))));
-        unit_card = fmt::format("{}_info.tga", u.dictionary);
-        if (not fs::exists(
-              fmt::format("data/ui/unit_info/{}/{}", owner, unit_card)))
-          problems.push_back(
-            fmt::format("{} missing from {}.", sgr::problem(unit_card),
-                        sgr::file(fmt::format("data/ui/unit_info/{}", owner))));
-      }
+  }
+  if (units.size() != unit_views.size())
+    ++mismatches;
+
+  auto [bms, bms_ms] = timed(
+    []() { return parse_battle_models_with_dcc(locate(g::dmb_filename)); });
+  mapped_file dmb;
+  auto [bm_views, bm_views_ms] = timed([&dmb]() {
+    dmb = map_file(g::dmb_filename);
+    return parse_battle_models(dmb);
+  });
+  dcc_loginf("{}: {} models in {:.2f} ms parsed, {} in {:.2f} ms mapped.",
+             sgr::file(g::dmb_filename), bms.size(), bms_ms, bm_views.size(),
+             bm_views_ms);
+  for (const auto& [name, bm] : bms) {
+    auto it = bm_views.find(name);
+    if (it == bm_views.end() or bm != to_battle_model(it->second)) {
+      dcc_logerr("{} at {} differs between parsers.", sgr::unique(name),
+                 sgr::file(fmt::format("{}:{}", g::dmb_filename, bm.lineno)));
+      ++mismatches;
     }
+  }
+  if (bms.size() != bm_views.size())
+    ++mismatches;
 
-    unordered_set<string> missing_textures;
-    unordered_set<string> handled_troops;
-    auto verify_bm = [&handled_troops, &battle_models, &problems, &u,
-                      &missing_textures](vector<string> troops) -> void {
-      for (const auto& soldier : troops) {
-        if (handled_troops.contains(soldier))
-          continue;
-        handled_troops.insert(soldier);
-        if (not battle_models.contains(soldier)) {
-          problems.push_back(fmt::format("{} missing from {}.",
-                                         sgr::problem(soldier),
-                                         sgr::file(g::dmb_filename)));
-          continue;
-        }
-
-        // Verify models
-        for (const auto& mpath : battle_models.at(soldier).model_paths) {
-          if (not fs::exists(mpath)) {
-            problems.push_back(fmt::format(
-              "Model {} missing from path for {} at {}.", sgr::file(mpath),
-              sgr::semiunique(soldier),
-              sgr::file(fmt::format("{}:{}", g::dmb_filename,
-                                    battle_models.at(soldier).lineno))));
-          }
-        }
-
-        // Verify textures
-        const auto& textures = battle_models[soldier].textures;
-        const auto& pbr_textures = battle_models[soldier].pbr_textures;
-        if (not pbr_textures.contains("default")) {
-          problems.push_back(
-            fmt::format("Missing default pbr_texture for {} at {}.",
-                        sgr::semiunique(soldier),
-                        sgr::file(fmt::format("{}:{}", g::dmb_filename,
-                                              battle_models[soldier].lineno))));
-        }
-        if (not textures.contains("default")) {
-          problems.push_back(fmt::format(
-            "Missing default texture for {} at {}.", sgr::semiunique(soldier),
-            sgr::file(fmt::format("{}:{}", g::dmb_filename,
-                                  battle_models[soldier].lineno))));
-        }
-        if (g::check_all_factions) {
-          for (const auto& owner : u.owners) {
-            if (g::ignore_slave and owner == "slave")
-              continue;
-            if (not pbr_textures.contains(owner))
-              problems.push_back(fmt::format(
-                "Missing pbr_texture for {} for {} at {}.",
-                sgr::semiunique(soldier), sgr::unique(owner),
-                sgr::file(fmt::format("{}:{}", g::dmb_filename,
-                                      battle_models[soldier].lineno))));
-            if (not textures.contains(owner))
-              problems.push_back(fmt::format(
-                "Missing texture for {} for {} at {}.",
-                sgr::semiunique(soldier), sgr::unique(owner),
-                sgr::file(fmt::format("{}:{}", g::dmb_filename,
-                                      battle_models[soldier].lineno))));
-          }
-        }
-
-        auto check_disk_for_textures =
-          [&problems, &soldier,
-           &missing_textures](unordered_map<string, texture> textures) {
-            for (const auto& [owner, texture] : textures) {
-              if (not g::check_all_referenced_paths and owner != "default")
-                continue;
-
-              // For some reason, the game's files reference by one extension,
-              // while the files exist on disk by another.
-              string actual_path = fmt::format("{}.dds", texture.path);
-              if (not fs::exists(actual_path) and
-                  not missing_textures.contains(actual_path)) {
-                problems.push_back(
-                  fmt::format("Texture {} missing from path for {} at {}.",
-                              sgr::file(actual_path), sgr::semiunique(soldier),
-                              sgr::file(fmt::format("{}:{}", g::dmb_filename,
-                                                    texture.lineno))));
-                missing_textures.insert(actual_path);
-              }
-            }
-          };
-        check_disk_for_textures(pbr_textures);
-        check_disk_for_textures(textures);
-      }
-    };
-    verify_bm(u.soldiers);
-    verify_bm(u.officers);
-
-    if (not problems.empty()) {
-      g::no_problems = false;
-      ++g::problem_count;
-      flogmsg(stderr, "", "\n{} {} at {}:",
-              fmt::format(fg(fmt::color::white), "{})", g::problem_count),
-              sgr::unique(u.dictionary),
-              sgr::file(fmt::format("{}:{}", g::edu_filename, u.lineno)));
-      for (size_t i = 0; i < problems.size(); ++i)
-        flogmsg(stderr, "", "\t {} {}{}",
-                fmt::format(fmt::fg(fmt::color::white), "{}.", i + 1),
-                string(int(log10(problems.size())) - int(log10(i + 1)), ' '),
-                problems[i]);
-    }
+  if (mismatches == 0)
+    dcc_logmsg("Both parsers agree.");
+  else {
+    dcc_logerr("Parsers disagree on {} entries.", sgr::problem(mismatches));
+    exit(-1);
   }
-  if (g::no_problems)
-    dcc_logmsg("All {} units are valid.", sgr::semiunique(units.size()));
 }
 
 int main(int argc, char** argv) {
@@ -493,6 +309,94 @@ int main(int argc, char** argv) {
       g::verify_characters = true;
     else if (s == "--verify-banners")
       g::verify_banners = true;
+    else if (s == "--all")
+      g::verify_all = true;
+    else if (s == "--mmap")
+      g::mapped = true;
+    else if (s == "--compare-parsers")
+      g::compare_parsers = true;
+    else if (s == "--cache")
+      g::use_cache = true;
+    else if (s == "--snapshot")
+      g::use_snapshots = true;
+    else if (s == "--watch")
+      g::watch = true;
+    else if (s == "--stats")
+      g::stats = true;
+    else if (s == "--validate-assets")
+      g::validate_assets = true;
+    else if (s == "--scan-models")
+      g::scan_models = true;
+    else if (s == "--find-orphans")
+      g::find_orphans = true;
+    else if (s == "--find-unused-units")
+      g::find_unused_units = true;
+    else if (s == "--serve")
+      g::serve = true;
+    else if (s == "--socket") {
+      if (i + 1 == argc) {
+        dcc_logerr("--socket needs a path to listen at.");
+        exit(-1);
+      }
+
+      // Relative to where we were started, not to the mod.
+      g::socket_path = fs::absolute(argv[++i]).string();
+    }
+    else if (s == "--base") {
+      if (i + 1 == argc) {
+        dcc_logerr("--base needs a directory to layer the mod over.");
+        exit(-1);
+      }
+
+      // Relative to where we were started, not to the mod.
+      g::base_dirs.push_back(
+        fs::absolute(argv[++i]).lexically_normal().generic_string());
+    }
+    else if (s == "--query") {
+      if (i + 1 == argc) {
+        dcc_logerr("--query needs a name or path to look up.");
+        exit(-1);
+      }
+      g::queries.push_back(argv[++i]);
+    }
+    else if (s == "--report") {
+      string format = i + 1 == argc ? "" : argv[++i];
+      if (format == "human")
+        g::problems_format = report_format::human;
+      else if (format == "jsonl")
+        g::problems_format = report_format::json_lines;
+      else if (format == "sarif")
+        g::problems_format = report_format::sarif;
+      else {
+        dcc_logerr("--report needs one of human, jsonl or sarif.");
+        exit(-1);
+      }
+    }
+    else if (s == "--report-file") {
+      if (i + 1 == argc) {
+        dcc_logerr("--report-file needs a file to write to.");
+        exit(-1);
+      }
+      g::problems_path = fs::absolute(argv[++i]).string();
+    }
+    else if (s == "--trace") {
+      if (i + 1 == argc) {
+        dcc_logerr("--trace needs a file to write to.");
+        exit(-1);
+      }
+
+      // Relative to where we were started, not to the mod.
+      g::trace_path = fs::absolute(argv[++i]).string();
+    }
+    else if (s == "--jobs") {
+
+      // 0 means one job per hardware thread.
+      if (i + 1 == argc or not isdigit(argv[i + 1][0])) {
+        dcc_logerr("--jobs needs a number of jobs.");
+        exit(-1);
+      }
+      g::jobs = stoul(argv[++i]);
+    }
     else {
       if (i == 0)
         continue;
@@ -507,6 +411,37 @@ int main(int argc, char** argv) {
   }
 
   fs::current_path(g::root_dir);
+  for (const auto& dir : g::base_dirs) {
+    if (not fs::is_directory(dir)) {
+      dcc_logerr("{} given to --base is not a directory.", sgr::file(dir));
+      exit(-1);
+    }
+    if (g::assets.add_layer(dir) == -1) {
+      dcc_logerr("Could not layer the mod over {}: {}.", sgr::file(dir),
+                 errmsg());
+      exit(-1);
+    }
+  }
+  if (g::stats or not g::trace_path.empty())
+    prof.enable(not g::trace_path.empty());
+
+  if (not g::generate_export_units and g::queries.empty() and
+      not g::find_orphans and not g::find_unused_units) {
+    dcc_logmsg("Indexing {}...", sgr::file("data"));
+    profiler::span span("index");
+    g::assets.build("data");
+    dcc_logmsg("Indexed {} paths.", sgr::semiunique(g::assets.size()));
+    for (size_t i = 1; i < g::assets.layer_count(); ++i)
+      dcc_loginf("Falling back to {} for what the mod lacks.",
+                 sgr::file(g::assets.layer_root(i)));
+  }
+
+  if (g::jobs != 1) {
+    g::pool = make_unique<thread_pool>(g::jobs);
+    dcc_loginf("Will verify using {} threads.",
+               sgr::semiunique(g::pool->size()));
+  }
+  set_parse_threads(g::pool ? g::pool->size() : 1);
 
   auto print_flag_info = []() {
     if (g::check_all_factions)
@@ -517,18 +452,34 @@ int main(int argc, char** argv) {
       dcc_loginf("Will not verify slave faction.");
   };
 
-  if (g::verify_characters) {
-    print_flag_info();
-    verify_strat_models();
-  }
-  else if (g::verify_banners)
-    verify_banners();
-  else if (g::generate_export_units)
+  if (g::generate_export_units)
     generate_export_units(argv[0]);
+  else if (not g::queries.empty())
+    query();
+  else if (g::find_orphans)
+    find_orphans();
+  else if (g::find_unused_units)
+    find_unused_units();
+  else if (g::compare_parsers)
+    compare_parsers();
+  else if (g::serve)
+    serve_requests();
   else {
-    print_flag_info();
-    verify_units();
+    if (g::verify_all or not g::verify_banners)
+      print_flag_info();
+    if (g::watch)
+      watch();
+    else if (g::mapped and not g::verify_characters and
+             not g::verify_banners and not g::validate_assets and
+             not g::scan_models)
+      verify_mapped_units();
+    else {
+      mod_state st;
+      parse_stage stage(st, definition_files());
+      verify(st, stage);
+    }
   }
+  report_profile();
 
   return 0;
 }
@@ -0,0 +1,74 @@
+#include <dcc/errno.hpp>
+#include <dcc/logger.hpp>
+#include <algorithm>
+#include <charconv>
+#include <cstdio>
+#include <string>
+#include <string_view>
+
+#include "local_socket.hpp"
+#include "verification.hpp"
+
+using namespace std;
+using namespace dcc;
+
+// Sends one request to the verificator running with --serve on a mod, and
+// prints its answer:
+//
+//   verificator_client <mod dir> <command> [argument...] [--socket PATH]
+//
+// The socket defaults to the one --serve listens at for that mod. Exits with
+// -1 if the request failed, as when a name isn't defined.
+int main(int argc, char** argv) {
+  string socket_path;
+  string dir;
+  string request;
+  for (int i = 1; i < argc; ++i) {
+    string s = argv[i];
+    if (s == "--socket") {
+      if (i + 1 == argc) {
+        dcc_logerr("--socket needs the path the verificator listens at.");
+        exit(-1);
+      }
+      socket_path = argv[++i];
+    }
+    else if (dir.empty())
+      dir = s;
+    else if (request.empty())
+      request = s;
+    else
+      request += " " + s;
+  }
+  if (dir.empty() or request.empty()) {
+    dcc_logerr("No mod directory or request given.");
+    exit(-1);
+  }
+  if (socket_path.empty())
+    socket_path = fmt::format("{}/{}/verificator.sock", dir, g::cache_dir);
+
+  int fd = connect_local(socket_path);
+  if (fd == -1) {
+    dcc_logerr("Could not connect to {}: {}.", sgr::file(socket_path),
+               errmsg());
+    exit(-1);
+  }
+  string buf, header, answer;
+  if (send_all(fd, request + "\n") == -1 or
+      read_line(fd, buf, header) != 1) {
+    dcc_logerr("No answer from {}.", sgr::file(socket_path));
+    exit(-1);
+  }
+  size_t space = header.find(' ');
+  size_t size = 0;
+  const char* end = header.data() + header.size();
+  auto [ptr, ec] =
+    from_chars(header.data() + min(space + 1, header.size()), end, size);
+  if (space == string::npos or ec != errc() or ptr != end or
+      read_bytes(fd, buf, size, answer) != 1) {
+    dcc_logerr("Malformed answer from {}.", sgr::file(socket_path));
+    exit(-1);
+  }
+  close_local(fd);
+  fwrite(answer.data(), 1, answer.size(), stdout);
+  return header.starts_with("ok") ? 0 : -1;
+}